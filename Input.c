@@ -11,593 +11,2812 @@
 
 #include "Input.h"
 #include "InputSys.h"
-#include "Types/List.h"
 #include "Platform/Alloc.h"
 #include "Platform/Window.h"
 #include <assert.h>
+#include <string.h>
+
+// Hit testing of mouse binds uses the widest vector instructions the library is compiled for.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define INPUT_HIT_TEST_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define INPUT_HIT_TEST_SSE2
+#endif
+
+// --------------------------------------------------
+
+// Bind tables, one for each bind type
+typedef enum {
+	TABLE_CHAR,
+	TABLE_KEYUP,
+	TABLE_KEYDOWN,
+	TABLE_BTNUP,
+	TABLE_BTNDOWN,
+	TABLE_MOVE,
+	TABLE_ENTER,
+	TABLE_LEAVE,
+	NUM_BIND_TABLES,
+	FIRST_MOUSE_TABLE = TABLE_BTNUP,
+} BINDTABLE;
+
+// Input hook function
+typedef struct {
+	input_handler_t			handler;		// Hook without userdata, or NULL
+	input_data_handler_t	data_handler;	// Hook with userdata, or NULL (both are NULL when the hook has been removed)
+	void*					userdata;
+} InputHook;
+
+// A contiguous array of the hooks of a single input event, in the order they were added
+typedef struct {
+	InputHook*			hooks;
+	uint32				count;		// Number of hooks, including removed ones awaiting compaction
+	uint32				capacity;	// Number of hooks allocated
+	uint32				removed;	// Number of removed hooks awaiting compaction
+} HookArray;
+
+// Handler of a key or mouse bind, the rest of the bind is stored in the arrays of its table
+typedef struct {
+	union {
+		keybind_func_t		key_handler;
+		mousebind_func_t	mouse_handler;
+	};
+	void*				userdata;
+} BindRecord;
+
+// A non-rectangular hit area of a mouse bind, tested after the point has been found inside the bind's bounds
+typedef struct {
+	uint8				type;		// HITSHAPE_ELLIPSE or HITSHAPE_MASK
+	int16				x, y;		// Top left corner of the shape
+	uint16				width;		// Size of the shape in pixels
+	uint16				height;
+	uint32				stride;		// Number of 32-bit words in a row of the mask
+	uint32				size;		// Size of the allocation in bytes
+} HitShape;
+
+typedef enum {
+	HITSHAPE_ELLIPSE,				// Ellipse that fills the shape
+	HITSHAPE_MASK,					// A bit for each pixel of the shape, stored right after the header
+} HITSHAPE;
+
+#define HITSHAPE_BITS(shape)	( (uint32*)( (shape) + 1 ) )
+#define HITSHAPE_MAX_PIXELS		( 1 << 24 )	// Largest mask allowed, 2 megabytes
+
+// Rate limiting of a move bind (see input_set_mousebind_interval)
+typedef struct {
+	uint64				interval;	// Minimum time between calls in nanoseconds, 0 when the bind isn't throttled
+	uint64				last_call;	// Time of the last call
+	int16				x, y;		// Newest position that hasn't been delivered yet
+	bool				pending;	// Is a trailing call waiting for the interval to pass
+} BindThrottle;
+
+// The binds of a single type as parallel arrays, indexed by the position of the bind in the table
+typedef struct {
+	BindRecord*			records;	// Handlers and userdata
+	uint32*				slots;		// Slot of each bind's handle (BIND_REMOVED when the bind has been removed)
+	uint16*				tags;		// Key tables: interned key (see input_intern_key) and TAG_FOCUSABLE, mouse tables: button and TAG_HOVERED
+	int16*				bounds;		// Mouse tables: bind areas as separate left, top, right and bottom arrays
+	HitShape**			shapes;		// Mouse tables: shape of each bind (NULL for rectangles), NULL until the table has a shaped bind
+	BindThrottle*		throttles;	// Move table: rate limit of each bind, NULL until a bind is throttled
+	uint8*				flags;		// Options of each bind (BIND_FLAG_*), NULL until a bind has one
+	uint32				count;		// Number of binds, including removed ones awaiting compaction
+	uint32				capacity;	// Number of binds allocated
+	uint32				removed;	// Number of removed binds awaiting compaction
+} BindTable;
+
+#define TAG_BUTTON_MASK			0x00FF	// Mouse button of a mouse bind (MOUSEBTN)
+#define TAG_HOVERED				0x0100	// Enter/leave binds: was the cursor inside the bind during the last check
+
+#define TAG_KEY_MASK			0x7FFF	// Interned key of a key bind
+#define TAG_FOCUSABLE			0x8000	// Key binds which are only called through the focus chain (see input_set_key_focus)
+
+#define BIND_FLAG_PARALLEL		0x01	// Handler can run on the worker pool (see input_set_keybind_parallel)
+
+#define KEY_INDEX_NONE			0xFFFF	// Key that hasn't been interned, no bind has ever used it
+#define KEY_INDEX_MAX			0x7FFE
+
+#define INPUT_QUEUE_MAX			16384	// Maximum number of events waiting in the queue
+
+// A slot which maps a bind handle to the bind's current location
+typedef struct {
+	uint16				generation;	// Incremented whenever the slot is freed, invalidating old handles
+	uint16				table;		// Table the bind lives in (NUM_BIND_TABLES when the slot is free)
+	uint32				index;		// Index of the bind in the table, or the next free slot
+} BindSlot;
+
+/*
+ * Bind handles (KeyBind* and MouseBind*) are not real pointers but generational indices into the slot array:
+ * the lowest BIND_INDEX_BITS bits contain the slot index and the rest the generation of the slot when the handle
+ * was created. A handle of a removed bind is detected by its generation no longer matching the slot.
+ * The generation is never zero, so no valid handle is ever NULL.
+ */
+#define BIND_INDEX_BITS			20
+#define BIND_MAX_SLOTS			( 1 << BIND_INDEX_BITS )
+#define BIND_GENERATION_MASK	0xFFF
+#define BIND_REMOVED			0xFFFFFFFF
+#define BIND_NO_SLOT			0xFFFFFFFF
+
+#define BIND_RECORD(table, i)	( &bind_tables[table].records[i] )
+
+/*
+ * The areas of mouse binds are kept apart from the records so that a point can be tested against a whole block
+ * of binds at once. Each edge has an array of its own (capacity entries each, back to back in one allocation).
+ * The edges are inclusive like in rect_is_point_in, and right/bottom are clamped to the int16 range, which can't
+ * change the result for any int16 point. Removed binds get an empty area so they can never be hit.
+ */
+#define BOUNDS_LEFT(t)			( (t)->bounds )
+#define BOUNDS_TOP(t)			( (t)->bounds + (t)->capacity )
+#define BOUNDS_RIGHT(t)			( (t)->bounds + (t)->capacity * 2 )
+#define BOUNDS_BOTTOM(t)		( (t)->bounds + (t)->capacity * 3 )
+#define BOUNDS_EMPTY_MIN		32767
+#define BOUNDS_EMPTY_MAX		-32768
+#define HIT_TEST_BLOCK			16	// Number of binds tested at once, table capacities are a multiple of this
 
 // --------------------------------------------------
 
 static bool		input_initialized				= false;	// Is the library properly initialized?
 static bool		block_keys						= false;	// Should keyboard input be blocked
 bool			show_cursor						= true;		// Display mouse cursor
+bool			pointer_locked					= false;	// Is the pointer locked to the window (relative mode)
 int16			mouse_x							= 0;		// Current mouse x coordinate
 int16			mouse_y							= 0;		// Current mouse y coordinate
-static list_t*	input_hooks[NUM_INPUT_EVENTS]	= { NULL };	// A list of custom input hooks
-static list_t*	char_binds						= NULL;		// Character input binds
-static list_t*	key_up_binds					= NULL;		// Key up hooks
-static list_t*	key_down_binds					= NULL;		// Key down hooks
-static list_t*	mouse_up_binds					= NULL;		// Mouse button up binds
-static list_t*	mouse_down_binds				= NULL;		// Mouse button down binds
-static list_t*	mouse_move_binds				= NULL;		// Mouse move binds
+static uint8	input_modifiers					= 0;		// Modifier keys held down (see MODIFIER)
+static uint8	input_buttons					= 0;		// Mouse buttons held down (see MOUSEMASK)
+static HookArray input_hooks[NUM_INPUT_EVENTS];				// Custom input hooks
+static BindTable bind_tables[NUM_BIND_TABLES];				// Key and mouse binds
+static BindSlot* bind_slots						= NULL;		// Handle slots of all binds
+static uint32	num_slots						= 0;		// Number of slots in use or in the free list
+static uint32	slot_capacity					= 0;		// Number of slots allocated
+static uint32	free_slots_head					= BIND_NO_SLOT;	// First slot of the free list
+static uint32	free_slots_tail					= BIND_NO_SLOT;	// Last slot of the free list
+static uint32	dispatch_depth					= 0;		// Number of bind dispatches currently in progress
+static uint32	input_listeners					= 0;		// Input events with at least one hook or bind
+static uint32	input_consumers[NUM_INPUT_EVENTS];			// Internal users of each event (see input_add_consumer)
+static InputEventStats event_stats[NUM_INPUT_EVENTS];		// Event counters for input_get_stats
+static bool		keys_blocked					= false;	// Was the last keyboard event blocked by block_keys
+static uint32	bounds_serial					= 0;		// Incremented whenever the area of a mouse bind changes
+static uint64	memory_peak						= 0;		// Largest amount of memory allocated at once
+static uint64	shape_memory					= 0;		// Memory allocated for the hit shapes of mouse binds
+static uint64	dispatch_time					= 0;		// Time of the event being dispatched
+static uint32*	key_map_keys					= NULL;		// Interned keys, an open addressing hash table
+static uint16*	key_map_indices					= NULL;		// Index of each interned key (KEY_INDEX_NONE if the entry is empty)
+static uint32	key_map_capacity				= 0;		// Size of the hash table (always a power of two)
+static uint32	num_keys						= 0;		// Number of keys interned
+static uint64	event_time						= 0;		// Timestamp for posted events, 0 to stamp them when posted
+static bool		queued_dispatch					= false;	// Are events queued until input_dispatch is called
+static bool		dispatching_queue				= false;	// Is input_dispatch currently running
+static QueuedEvent* event_queue					= NULL;		// Ring buffer of events waiting to be dispatched
+static uint32	queue_head						= 0;		// Index of the oldest event in the queue
+static uint32	queue_count						= 0;		// Number of events in the queue
+static uint32	queue_capacity					= 0;		// Size of the ring buffer (always a power of two)
+static bool		mouse_captured					= false;	// Is the pointer captured by a bind (see input_capture_mouse)
+static MouseBind* capture_move					= NULL;		// Move bind receiving all motion while the pointer is captured
+static MouseBind* capture_release				= NULL;		// Button up bind receiving the release that ends the capture
+static MOUSEBTN	capture_button					= MOUSE_NONE;	// Button whose release ends the capture (MOUSE_NONE for any)
+static MOUSEBTN	pressed_button					= MOUSE_NONE;	// Button of the press being dispatched to down binds
+static KeyBind*	focus_chain[INPUT_MAX_FOCUS_CHAIN];			// Key binds with keyboard focus, innermost first
+static uint32	focus_count						= 0;		// Number of binds in the focus chain
+static InputJob* parallel_jobs					= NULL;		// Parallel handlers of the event being dispatched
+static uint32	jobs_capacity					= 0;		// Number of jobs allocated
 
 // --------------------------------------------------
 
-// Input hook functions
-typedef struct {
-	node_t node;
-	input_handler_t handler;
-} InputHookFunc;
+static bool input_table_empty( uint32 table )
+{
+	return bind_tables[table].count == bind_tables[table].removed;
+}
 
-// Keyboard bind types
-typedef enum {
-	BIND_KEYUP,
-	BIND_KEYDOWN,
-	BIND_CHAR,
-} BINDTYPE_KB;
+void input_update_listeners( void )
+{
+	uint32 i, events = 0;
 
-// Mouse bind types
-typedef enum {
-	BIND_BTNUP,
-	BIND_BTNDOWN,
-	BIND_MOVE
-} BINDTYPE_MOUSE;
-
-// Keybind structure
-struct KeyBind {
-	node_t			node;
-	BINDTYPE_KB		type;
-	uint32			key;
-	keybind_func_t	handler;
-	void*			userdata;
-};
-
-// Mousebind structure
-struct MouseBind {
-	node_t				node;
-	BINDTYPE_MOUSE		type;
-	rectangle_t			bounds;
-	MOUSEBTN			button;
-	mousebind_func_t	handler;
-	void*				userdata;
-};
+	if ( !input_initialized ) return;
 
-// --------------------------------------------------
+	for ( i = 0; i < NUM_INPUT_EVENTS; i++ )
+	{
+		if ( input_hooks[i].count != input_hooks[i].removed ) events |= INPUT_EVENT_BIT(i);
+	}
+
+	if ( !input_table_empty( TABLE_CHAR ) ) events |= INPUT_EVENT_BIT(INPUT_CHARACTER);
+	if ( !input_table_empty( TABLE_KEYUP ) ) events |= INPUT_EVENT_BIT(INPUT_KEY_UP);
+	if ( !input_table_empty( TABLE_KEYDOWN ) ) events |= INPUT_EVENT_BIT(INPUT_KEY_DOWN);
+	if ( input_is_keymap_loaded() ) events |= INPUT_EVENT_BIT(INPUT_KEY_UP)|INPUT_EVENT_BIT(INPUT_KEY_DOWN);
+	if ( !input_table_empty( TABLE_MOVE ) ) events |= INPUT_EVENT_BIT(INPUT_MOUSE_MOVE);
+	if ( !input_table_empty( TABLE_ENTER ) ) events |= INPUT_EVENT_BIT(INPUT_MOUSE_MOVE);
+	if ( !input_table_empty( TABLE_LEAVE ) ) events |= INPUT_EVENT_BIT(INPUT_MOUSE_MOVE);
+
+	if ( !input_table_empty( TABLE_BTNUP ) )
+		events |= INPUT_EVENT_BIT(INPUT_LBUTTON_UP)|INPUT_EVENT_BIT(INPUT_MBUTTON_UP)|INPUT_EVENT_BIT(INPUT_RBUTTON_UP);
+
+	if ( !input_table_empty( TABLE_BTNDOWN ) )
+		events |= INPUT_EVENT_BIT(INPUT_LBUTTON_DOWN)|INPUT_EVENT_BIT(INPUT_MBUTTON_DOWN)|INPUT_EVENT_BIT(INPUT_RBUTTON_DOWN);
+
+	// Shared state, tick resampling and cursor prediction see every event without any binds.
+	for ( i = 0; i < NUM_INPUT_EVENTS; i++ )
+	{
+		if ( input_consumers[i] != 0 ) events |= INPUT_EVENT_BIT(i);
+	}
+
+	// Only bother the platform implementation when the set actually changes.
+	if ( events != input_listeners )
+	{
+		input_listeners = events;
+		input_platform_set_listeners( events );
+	}
+}
+
+void input_count_dropped( INPUT_EVENT type )
+{
+	// Called from the input thread as well, the counters are atomic.
+	input_stat_add( event_stats[type].received, 1 );
+	input_stat_add( event_stats[type].dropped, 1 );
+}
+
+void input_add_consumer( uint32 events, bool add )
+{
+	uint32 i;
+
+	for ( i = 0; i < NUM_INPUT_EVENTS; i++ )
+	{
+		if ( !( events & INPUT_EVENT_BIT(i) ) ) continue;
+
+		if ( add ) input_consumers[i]++;
+		else if ( input_consumers[i] != 0 ) input_consumers[i]--;
+	}
+
+	input_update_listeners();
+}
+
+bool input_has_listeners( INPUT_EVENT type )
+{
+	return ( input_listeners & INPUT_EVENT_BIT(type) ) != 0;
+}
+
+static uint64 input_get_memory_used( void )
+{
+	uint64 bytes;
+	uint32 i;
+
+	bytes = (uint64)slot_capacity * sizeof(BindSlot) + (uint64)queue_capacity * sizeof(QueuedEvent);
+
+	for ( i = 0; i < NUM_BIND_TABLES; i++ )
+	{
+		bytes += (uint64)bind_tables[i].capacity * ( sizeof(BindRecord) + sizeof(uint32) + sizeof(uint16) );
+		if ( bind_tables[i].bounds != NULL ) bytes += (uint64)bind_tables[i].capacity * 4 * sizeof(int16);
+		if ( bind_tables[i].shapes != NULL ) bytes += (uint64)bind_tables[i].capacity * sizeof(HitShape*);
+		if ( bind_tables[i].throttles != NULL ) bytes += (uint64)bind_tables[i].capacity * sizeof(BindThrottle);
+		if ( bind_tables[i].flags != NULL ) bytes += (uint64)bind_tables[i].capacity * sizeof(uint8);
+	}
+
+	bytes += (uint64)key_map_capacity * ( sizeof(uint32) + sizeof(uint16) );
+	bytes += shape_memory;
+	bytes += (uint64)jobs_capacity * sizeof(InputJob);
+
+	for ( i = 0; i < NUM_INPUT_EVENTS; i++ )
+		bytes += (uint64)input_hooks[i].capacity * sizeof(InputHook);
+
+	return bytes;
+}
+
+static void input_track_memory( void )
+{
+	uint64 bytes = input_get_memory_used();
+
+	// Only called after something grows, memory never peaks when it's being freed.
+	if ( bytes > memory_peak ) memory_peak = bytes;
+}
 
 void input_initialize( void* window )
+{
+	input_initialize_ex( window, 0 );
+}
+
+void input_initialize_ex( void* window, uint32 flags )
 {
 	uint32 i;
 
 	if ( !window ) return;
 
-	// Initialize hook lists
+	// Initialize hook arrays
 	for ( i = NUM_INPUT_EVENTS; i--; )
-		input_hooks[i] = list_create();
+		memset( &input_hooks[i], 0, sizeof(input_hooks[i]) );
+
+	// Initialize key/mouse bind tables
+	for ( i = NUM_BIND_TABLES; i--; )
+		memset( &bind_tables[i], 0, sizeof(bind_tables[i]) );
 
-	// Initialize key/mouse binds
-	char_binds = list_create();
-	key_up_binds = list_create();
-	key_down_binds = list_create();
-	mouse_up_binds = list_create();
-	mouse_down_binds = list_create();
-	mouse_move_binds = list_create();
+	memory_peak = 0;
 
 	// Do window system specific initializing (event hooks etc)
 	input_platform_initialize( window );
 
 	input_initialized = true;
-}
-
-static void input_cleanup_list( list_t* list )
-{
-	node_t *node, *tmp;
 
-	list_foreach_safe( list, node, tmp )
-	{
-		list_remove( list, node );
-		mem_free( node );
-	}
+	// Pick up anything that was enabled before the library was.
+	input_update_listeners();
 
-	list_destroy( list );
+	// The thread is optional, if it can't be started input is simply read on the main thread.
+	if ( flags & INPUT_INIT_THREAD )
+		input_platform_start_thread();
 }
 
 void input_shutdown( void )
 {
-	uint32 i;
+	uint32 i, j;
 
 	if ( !input_initialized ) return;
 
-	// Destroy input hook lists
+	input_listeners = 0;
+
+	// Destroy input hook arrays
 	for ( i = NUM_INPUT_EVENTS; i--; )
 	{
-		if ( input_hooks[i] != NULL )
+		mem_free( input_hooks[i].hooks );
+		memset( &input_hooks[i], 0, sizeof(input_hooks[i]) );
+	}
+
+	// Destroy key/mouse binds
+	for ( i = NUM_BIND_TABLES; i--; )
+	{
+		mem_free( bind_tables[i].records );
+		mem_free( bind_tables[i].slots );
+		mem_free( bind_tables[i].tags );
+		mem_free( bind_tables[i].bounds );
+
+		if ( bind_tables[i].shapes != NULL )
 		{
-			input_cleanup_list( input_hooks[i] );
-			input_hooks[i] = NULL;
+			for ( j = 0; j < bind_tables[i].count; j++ )
+				mem_free( bind_tables[i].shapes[j] );
+
+			mem_free( bind_tables[i].shapes );
 		}
+
+		mem_free( bind_tables[i].throttles );
+		mem_free( bind_tables[i].flags );
+
+		memset( &bind_tables[i], 0, sizeof(bind_tables[i]) );
 	}
 
-	// Destroy key/mouse binds
-	input_cleanup_list( char_binds );
-	input_cleanup_list( key_up_binds );
-	input_cleanup_list( key_down_binds );
-	input_cleanup_list( mouse_up_binds );
-	input_cleanup_list( mouse_down_binds );
-	input_cleanup_list( mouse_move_binds );
-
-	char_binds = NULL;
-	key_up_binds = NULL;
-	key_down_binds = NULL;
-	mouse_up_binds = NULL;
-	mouse_down_binds = NULL;
-	mouse_move_binds = NULL;
+	shape_memory = 0;
+
+	// The workers only ever run bind handlers, so they go away with the binds.
+	input_stop_workers();
+
+	mem_free( parallel_jobs );
+	parallel_jobs = NULL;
+	jobs_capacity = 0;
+
+	mem_free( key_map_keys );
+	mem_free( key_map_indices );
+
+	key_map_keys = NULL;
+	key_map_indices = NULL;
+	key_map_capacity = 0;
+	num_keys = 0;
+
+	mouse_captured = false;
+	capture_move = NULL;
+	capture_release = NULL;
+	focus_count = 0;
+
+	mem_free( bind_slots );
+	mem_free( event_queue );
+
+	event_queue = NULL;
+	queue_head = 0;
+	queue_count = 0;
+	queue_capacity = 0;
+	queued_dispatch = false;
+
+	bind_slots = NULL;
+	num_slots = 0;
+	slot_capacity = 0;
+	free_slots_head = BIND_NO_SLOT;
+	free_slots_tail = BIND_NO_SLOT;
+
+	input_keymap_shutdown();
+	input_publish_state( NULL );
+	input_stop_ticks();
+	input_enable_prediction( false );
 
 	// Do window system specific cleanup
 	input_platform_shutdown();
+	input_trace_shutdown();
 
 	input_initialized = false;
 }
 
-void input_add_hook( INPUT_EVENT event_id, input_handler_t handler )
+static void input_insert_hook( INPUT_EVENT event_id, input_handler_t handler, input_data_handler_t data_handler, void* data )
 {
-	InputHookFunc* hook;
+	HookArray* array;
+	InputHook* hook;
 
 	if ( !input_initialized ) return;
 	if ( event_id >= NUM_INPUT_EVENTS ) return;
 
-	hook = mem_alloc_clean( sizeof(*hook) );
+	array = &input_hooks[event_id];
+
+	if ( array->count == array->capacity )
+	{
+		array->capacity = array->capacity ? array->capacity * 2 : 4;
+		array->hooks = mem_realloc( array->hooks, array->capacity * sizeof(*array->hooks) );
+
+		input_track_memory();
+	}
+
+	// New hooks go last so they're called in the order they were added.
+	hook = &array->hooks[array->count++];
 	hook->handler = handler;
+	hook->data_handler = data_handler;
+	hook->userdata = data;
 
-	list_push( input_hooks[event_id], &hook->node );
+	input_update_listeners();
 }
 
-void input_remove_hook( INPUT_EVENT event_id, input_handler_t handler )
+static void input_compact_hooks( INPUT_EVENT event_id )
 {
-	node_t* node;
-	InputHookFunc* hook;
-
-	if ( !input_initialized ) return;
-	if ( event_id >= NUM_INPUT_EVENTS ) return;
+	HookArray* array = &input_hooks[event_id];
+	uint32 i, j;
 
-	list_foreach( input_hooks[event_id], node )
+	for ( i = j = 0; i < array->count; i++ )
 	{
-		hook = (InputHookFunc*)node;
-		if ( handler == hook->handler )
-		{
-			list_remove( input_hooks[event_id], node );
-			mem_free( hook );
+		if ( array->hooks[i].handler == NULL && array->hooks[i].data_handler == NULL ) continue;
+		if ( i != j ) array->hooks[j] = array->hooks[i];
 
-			return;
-		}
+		j++;
 	}
+
+	array->count = j;
+	array->removed = 0;
 }
 
-static KeyBind* input_add_key_bind( uint32 key, keybind_func_t func, void* data, BINDTYPE_KB type )
+static void input_erase_hook( INPUT_EVENT event_id, input_handler_t handler, input_data_handler_t data_handler, void* data )
 {
-	KeyBind* bind;
-	list_t* bindlist = NULL;
+	HookArray* array;
+	InputHook* hook;
+	uint32 i;
 
-	if ( !input_initialized ) return NULL;
+	if ( !input_initialized ) return;
+	if ( event_id >= NUM_INPUT_EVENTS ) return;
 
-	switch ( type )
+	array = &input_hooks[event_id];
+
+	for ( i = 0; i < array->count; i++ )
 	{
-	case BIND_CHAR: bindlist = char_binds; break;
-	case BIND_KEYUP: bindlist = key_up_binds; break;
-	case BIND_KEYDOWN: bindlist = key_down_binds; break;
-	}
+		hook = &array->hooks[i];
 
-	if ( bindlist == NULL ) return NULL;
+		if ( hook->handler != handler || hook->data_handler != data_handler ) continue;
+		if ( data_handler != NULL && hook->userdata != data ) continue;
 
-	bind = mem_alloc_clean( sizeof(*bind) );
-	bind->type = type;
-	bind->key = key;
-	bind->handler = func;
-	bind->userdata = data;
+		// Hooks can't be moved while they're being called, in that case the array is compacted once the dispatch is done.
+		hook->handler = NULL;
+		hook->data_handler = NULL;
+		array->removed++;
 
-	list_push( bindlist, &bind->node );
+		if ( dispatch_depth == 0 ) input_compact_hooks( event_id );
 
-	return bind;
+		input_update_listeners();
+		return;
+	}
 }
 
-KeyBind* input_add_char_bind( uint32 key, keybind_func_t func, void* data )
+bool input_process( void* data )
 {
-	return input_add_key_bind( key, func, data, BIND_CHAR );
-}
+	bool ret;
 
-KeyBind* input_add_key_up_bind( uint32 key, keybind_func_t func, void* data )
-{
-	return input_add_key_bind( key, func, data, BIND_KEYUP );
-}
+	INPUT_TRACE_BEGIN( "input_process", 0 );
+	input_poll_keymap();
+	ret = input_platform_process( data );
+	INPUT_TRACE_END();
 
-KeyBind* input_add_key_down_bind( uint32 key, keybind_func_t func, void* data )
-{
-	return input_add_key_bind( key, func, data, BIND_KEYDOWN );
+	return ret;
 }
 
-static MouseBind* input_add_mouse_bind( MOUSEBTN button, rectangle_t* area, mousebind_func_t func, void* data, BINDTYPE_MOUSE type )
+uint32 input_wait( uint64 timeout_ns, const input_wait_t* handles, uint32 count )
 {
-	MouseBind* bind;
-	list_t* bindlist = NULL;
+	uint64 next;
+	uint32 ret;
 
-	if ( !input_initialized ) return NULL;
+	if ( !input_initialized ) return INPUT_WAIT_ERROR;
+	if ( count > INPUT_WAIT_MAX_HANDLES ) return INPUT_WAIT_ERROR;
 
-	switch ( type )
-	{
-		case BIND_MOVE: bindlist = mouse_move_binds; break;
-		case BIND_BTNUP: bindlist = mouse_up_binds; break;
-		case BIND_BTNDOWN: bindlist = mouse_down_binds; break;
-	}
+	INPUT_TRACE_BEGIN( "input_wait", 0 );
 
-	if ( bindlist == NULL ) return NULL;
+	// Don't sleep past the trailing call of a throttled bind.
+	next = input_flush_throttled();
+	if ( next < timeout_ns ) timeout_ns = next;
 
-	bind = mem_alloc_clean( sizeof(*bind) );
-	bind->type = type;
-	bind->bounds = *area;
-	bind->button = button;
-	bind->handler = func;
-	bind->userdata = data;
+	ret = input_platform_wait( timeout_ns, handles, count );
+	input_poll_keymap();
+
+	// Everything that arrived while sleeping is dispatched in one go.
+	if ( ( ret & INPUT_WAIT_INPUT ) && queued_dispatch )
+		input_dispatch( 0 );
+	else
+		input_flush_throttled();
 
-	list_push( bindlist, &bind->node );
+	INPUT_TRACE_END();
 
-	return bind;
+	return ret;
 }
 
-MouseBind* input_add_mouse_move_bind( rectangle_t* area, mousebind_func_t func, void* data )
+void input_add_hook( INPUT_EVENT event_id, input_handler_t handler )
 {
-	return input_add_mouse_bind( MOUSE_NONE, area, func, data, BIND_MOVE );
+	input_insert_hook( event_id, handler, NULL, NULL );
 }
 
-MouseBind* input_add_mousebtn_up_bind( MOUSEBTN button, rectangle_t* area, mousebind_func_t func, void* data )
+void input_add_data_hook( INPUT_EVENT event_id, input_data_handler_t handler, void* data )
 {
-	return input_add_mouse_bind( button, area, func, data, BIND_BTNUP );
+	input_insert_hook( event_id, NULL, handler, data );
 }
 
-MouseBind* input_add_mousebtn_down_bind( MOUSEBTN button, rectangle_t* area, mousebind_func_t func, void* data )
+void input_remove_hook( INPUT_EVENT event_id, input_handler_t handler )
 {
-	return input_add_mouse_bind( button, area, func, data, BIND_BTNDOWN );
+	if ( handler == NULL ) return;
+	input_erase_hook( event_id, handler, NULL, NULL );
 }
 
-static void input_remove_key_bind_from_list( uint32 key, keybind_func_t func, BINDTYPE_KB type )
+void input_remove_data_hook( INPUT_EVENT event_id, input_data_handler_t handler, void* data )
 {
-	KeyBind* bind;
-	node_t *node, *tmp;
-	list_t* bindlist = NULL;
-
-	if ( !input_initialized ) return;
+	if ( handler == NULL ) return;
+	input_erase_hook( event_id, NULL, handler, data );
+}
 
+static uint32 input_get_key_table( BINDTYPE_KB type )
+{
 	switch ( type )
 	{
-		case BIND_CHAR: bindlist = char_binds; break;
-		case BIND_KEYUP: bindlist = key_up_binds; break;
-		case BIND_KEYDOWN: bindlist = key_down_binds; break;
+	case BIND_CHAR: return TABLE_CHAR;
+	case BIND_KEYUP: return TABLE_KEYUP;
+	case BIND_KEYDOWN: return TABLE_KEYDOWN;
+	default: break;
 	}
 
-	if ( bindlist == NULL ) return;
+	return NUM_BIND_TABLES;
+}
 
-	list_foreach_safe( bindlist, node, tmp )
+static uint32 input_get_mouse_table( BINDTYPE_MOUSE type )
+{
+	switch ( type )
 	{
-		bind = (KeyBind*)node;
-		if ( bind->key == key && bind->handler == func )
-		{
-			list_remove( bindlist, node );
-			mem_free( bind );
-		}
+	case BIND_MOVE: return TABLE_MOVE;
+	case BIND_BTNUP: return TABLE_BTNUP;
+	case BIND_BTNDOWN: return TABLE_BTNDOWN;
+	case BIND_ENTER: return TABLE_ENTER;
+	case BIND_LEAVE: return TABLE_LEAVE;
+	default: break;
 	}
-}
 
-void input_remove_char_bind( uint32 key, keybind_func_t func )
-{
-	input_remove_key_bind_from_list( key, func, BIND_CHAR );
+	return NUM_BIND_TABLES;
 }
 
-void input_remove_key_up_bind( uint32 key, keybind_func_t func )
+static size_t input_get_bind_handle( uint32 slot )
 {
-	input_remove_key_bind_from_list( key, func, BIND_KEYUP );
+	return ( (size_t)bind_slots[slot].generation << BIND_INDEX_BITS ) | slot;
 }
 
-void input_remove_key_down_bind( uint32 key, keybind_func_t func )
+static uint32 input_resolve_bind_handle( const void* handle, uint32 first_table, uint32 last_table )
 {
-	input_remove_key_bind_from_list( key, func, BIND_KEYDOWN );
-}
+	size_t value = (size_t)handle;
+	uint32 slot = (uint32)( value & ( BIND_MAX_SLOTS - 1 ) );
 
-void input_remove_key_bind( KeyBind* bind )
-{
-	input_remove_key_bind_from_list( bind->key, bind->handler, bind->type );
+	// Stale handles are caught by the generation check, handles of the wrong kind by the table check.
+	if ( slot >= num_slots ) return BIND_NO_SLOT;
+	if ( ( value >> BIND_INDEX_BITS ) != bind_slots[slot].generation ) return BIND_NO_SLOT;
+	if ( bind_slots[slot].table < first_table || bind_slots[slot].table > last_table ) return BIND_NO_SLOT;
+
+	return slot;
 }
 
-static void input_remove_mouse_bind_from_list( MOUSEBTN button, mousebind_func_t func, BINDTYPE_MOUSE type )
+static bool input_get_key_bind( KeyBind* handle, uint32* table, uint32* index )
 {
-	MouseBind* bind;
-	node_t *node, *tmp;
-	list_t* bindlist = NULL;
+	uint32 slot;
 
-	if ( !input_initialized ) return;
+	if ( !input_initialized ) return false;
 
-	switch ( type )
-	{
-		case BIND_MOVE: bindlist = mouse_move_binds; break;
-		case BIND_BTNUP: bindlist = mouse_up_binds; break;
-		case BIND_BTNDOWN: bindlist = mouse_down_binds; break;
-	}
+	slot = input_resolve_bind_handle( handle, 0, FIRST_MOUSE_TABLE - 1 );
+	if ( slot == BIND_NO_SLOT ) return false;
 
-	if ( bindlist == NULL ) return;
+	*table = bind_slots[slot].table;
+	*index = bind_slots[slot].index;
 
-	list_foreach_safe( bindlist, node, tmp )
-	{
-		bind = (MouseBind*)node;
-		if ( bind->button == button && bind->handler != func )
-		{
-			list_remove( bindlist, node );
-			mem_free( bind );
-		}
-	}
+	return true;
 }
 
-void input_remove_mouse_move_bind( mousebind_func_t func )
+static bool input_get_mouse_bind( MouseBind* handle, uint32* table, uint32* index )
 {
-	input_remove_mouse_bind_from_list( MOUSE_NONE, func, BIND_MOVE );
-}
+	uint32 slot;
 
-void input_remove_mousebtn_up_bind( MOUSEBTN button, mousebind_func_t func )
-{
-	input_remove_mouse_bind_from_list( button, func, BIND_BTNUP );
-}
+	if ( !input_initialized ) return false;
 
-void input_remove_mousebtn_down_bind( MOUSEBTN button, mousebind_func_t func )
-{
-	input_remove_mouse_bind_from_list( button, func, BIND_BTNDOWN );
-}
+	slot = input_resolve_bind_handle( handle, FIRST_MOUSE_TABLE, NUM_BIND_TABLES - 1 );
+	if ( slot == BIND_NO_SLOT ) return false;
 
-void input_remove_mouse_bind( MouseBind* bind )
-{
-	input_remove_mouse_bind_from_list( bind->button, bind->handler, bind->type );
-}
+	*table = bind_slots[slot].table;
+	*index = bind_slots[slot].index;
 
-void input_set_mousebind_button( MouseBind* bind, MOUSEBTN button )
-{
-	if ( bind == NULL ) return;
-	bind->button = button;
+	return true;
 }
 
-void input_set_mousebind_rect( MouseBind* bind, rectangle_t* area )
+static uint32 input_hash_key( uint32 key )
 {
-	if ( bind == NULL ) return;
-	bind->bounds = *area;
-}
+	// Keys are often small characters or keysyms with a common prefix, mix the bits before masking.
+	key ^= key >> 16;
+	key *= 0x45D9F3B;
+	key ^= key >> 16;
 
-void input_set_mousebind_func( MouseBind* bind, mousebind_func_t func )
-{
-	if ( bind == NULL ) return;
-	bind->handler = func;
+	return key & ( key_map_capacity - 1 );
 }
 
-void input_set_mousebind_param( MouseBind* bind, void* data )
+static uint16 input_find_key( uint32 key )
 {
-	if ( bind == NULL ) return;
-	bind->userdata = data;
-}
+	uint32 i;
 
-void input_block_keys( bool block )
-{
-	block_keys = block;
-}
+	if ( key_map_capacity == 0 ) return KEY_INDEX_NONE;
 
-bool input_is_cursor_showing( void )
-{
-	return show_cursor;
+	for ( i = input_hash_key( key ); key_map_indices[i] != KEY_INDEX_NONE; i = ( i + 1 ) & ( key_map_capacity - 1 ) )
+	{
+		if ( key_map_keys[i] == key ) return key_map_indices[i];
+	}
+
+	return KEY_INDEX_NONE;
 }
 
-void input_get_cursor_pos( int16* x, int16* y )
+static void input_insert_key( uint32 key, uint16 index )
 {
-	*x = mouse_x;
-	*y = mouse_y;
+	uint32 i;
+
+	for ( i = input_hash_key( key ); key_map_indices[i] != KEY_INDEX_NONE; i = ( i + 1 ) & ( key_map_capacity - 1 ) );
+
+	key_map_keys[i] = key;
+	key_map_indices[i] = index;
 }
 
-bool input_handle_keyboard_event( INPUT_EVENT type, uint32 key )
+static uint16 input_intern_key( uint32 key )
 {
-	list_t* list;
-	node_t* node;
-	InputEvent event;
-	InputHookFunc* hook;
+	uint32 *keys, i, capacity;
+	uint16 *indices, index;
 
-	if ( !input_initialized ) return true;
-	if ( type >= NUM_INPUT_EVENTS ) return true;
+	// Binds store a 16-bit index of their key instead of the key itself. Keys stay interned until shutdown,
+	// there are only so many of them.
+	index = input_find_key( key );
+	if ( index != KEY_INDEX_NONE ) return index;
 
-	list = input_hooks[type];
+	if ( num_keys > KEY_INDEX_MAX ) return KEY_INDEX_NONE;
 
-	if ( list_empty(list) ) return true;
+	// Keep the hash table at most half full so that the probes stay short.
+	if ( ( num_keys + 1 ) * 2 > key_map_capacity )
+	{
+		keys = key_map_keys;
+		indices = key_map_indices;
+		capacity = key_map_capacity;
 
-	event.type = type;
-	event.keyboard.key = key;
+		key_map_capacity = capacity ? capacity * 2 : 64;
+		key_map_keys = mem_alloc( key_map_capacity * sizeof(*key_map_keys) );
+		key_map_indices = mem_alloc( key_map_capacity * sizeof(*key_map_indices) );
 
-	list_foreach( list, node )
-	{
-		hook = (InputHookFunc*)node;
+		memset( key_map_indices, 0xFF, key_map_capacity * sizeof(*key_map_indices) );
 
-		if ( !hook->handler( &event ) )
-			return false;
+		for ( i = 0; i < capacity; i++ )
+		{
+			if ( indices[i] != KEY_INDEX_NONE ) input_insert_key( keys[i], indices[i] );
+		}
+
+		mem_free( keys );
+		mem_free( indices );
+
+		input_track_memory();
 	}
 
-	if ( block_keys )
-		return false;
+	index = (uint16)num_keys++;
+	input_insert_key( key, index );
 
-	return true;
+	return index;
 }
 
-bool input_handle_mouse_event( INPUT_EVENT type, int16 x, int16 y, MOUSEBTN button, MOUSEWHEEL wheel )
+static bool input_reserve_slots( uint32 count )
 {
-	list_t* list;
-	node_t* node;
-	InputEvent event;
-	InputHookFunc* hook;
+	uint32 free_count = 0, slot, capacity;
 
-	if ( !input_initialized ) return true;
-	if ( type >= NUM_INPUT_EVENTS ) return true;
+	for ( slot = free_slots_head; slot != BIND_NO_SLOT && free_count < count; slot = bind_slots[slot].index )
+		free_count++;
 
-	list = input_hooks[type];
+	if ( free_count >= count ) return true;
 
-	if ( list_empty(list) ) return true;
+	count -= free_count;
 
-	event.type = type;
-	event.mouse.x = x;
-	event.mouse.y = y;
-	event.mouse.dx = x - mouse_x;
-	event.mouse.dy = y - mouse_y;
-	event.mouse.button = (uint8)button;
-	event.mouse.wheel = (uint8)wheel;
+	if ( num_slots + count > BIND_MAX_SLOTS ) return false;
+	if ( num_slots + count <= slot_capacity ) return true;
 
-	mouse_x = x;
-	mouse_y = y;
+	capacity = slot_capacity ? slot_capacity : 64;
+	while ( capacity < num_slots + count ) capacity *= 2;
 
-	list_foreach( list, node )
-	{
-		hook = (InputHookFunc*)node;
+	bind_slots = mem_realloc( bind_slots, capacity * sizeof(*bind_slots) );
+	slot_capacity = capacity;
 
-		if ( !hook->handler( &event ) )
-			return false;
-	}
+	input_track_memory();
 
 	return true;
 }
 
-bool input_handle_char_bind( uint32 key )
+static void input_resize_table( uint32 table, uint32 capacity )
 {
-	KeyBind* bind;
-	node_t *node, *tmp;
-	bool ret = true;
+	BindTable* t = &bind_tables[table];
+	int16* bounds;
+	uint32 i;
 
-	if ( !input_initialized ) return true;
+	t->records = mem_realloc( t->records, capacity * sizeof(*t->records) );
+	t->slots = mem_realloc( t->slots, capacity * sizeof(*t->slots) );
+	t->tags = mem_realloc( t->tags, capacity * sizeof(*t->tags) );
 
-	list_foreach_safe( char_binds, node, tmp )
+	if ( t->flags != NULL )
+		t->flags = mem_realloc( t->flags, capacity * sizeof(*t->flags) );
+
+	// The edge arrays are stored back to back, so each of them has to be moved to its new place separately.
+	if ( table >= FIRST_MOUSE_TABLE )
 	{
-		bind = (KeyBind*)node;
-		if ( !bind->handler( key, bind->userdata ) )
+		bounds = mem_alloc( 4 * capacity * sizeof(int16) );
+
+		if ( t->bounds != NULL )
 		{
-			ret = false;
+			for ( i = 0; i < 4; i++ )
+				memcpy( bounds + i * capacity, t->bounds + i * t->capacity, t->count * sizeof(int16) );
+
+			mem_free( t->bounds );
+		}
+
+		t->bounds = bounds;
+
+		if ( t->shapes != NULL )
+			t->shapes = mem_realloc( t->shapes, capacity * sizeof(*t->shapes) );
+
+		if ( t->throttles != NULL )
+			t->throttles = mem_realloc( t->throttles, capacity * sizeof(*t->throttles) );
+	}
+
+	t->capacity = capacity;
+
+	input_track_memory();
+}
+
+static bool input_reserve_records( uint32 table, uint32 count )
+{
+	BindTable* t = &bind_tables[table];
+	uint32 capacity;
+
+	if ( t->count + count <= t->capacity ) return true;
+
+	capacity = t->capacity ? t->capacity : HIT_TEST_BLOCK;
+	while ( capacity < t->count + count ) capacity *= 2;
+
+	input_resize_table( table, capacity );
+
+	return true;
+}
+
+static void input_set_bounds( uint32 table, uint32 index, const rectangle_t* area )
+{
+	BindTable* t = &bind_tables[table];
+	int32 right, bottom;
+
+	if ( area->w < 0 || area->h < 0 )
+	{
+		BOUNDS_LEFT(t)[index] = BOUNDS_TOP(t)[index] = BOUNDS_EMPTY_MIN;
+		BOUNDS_RIGHT(t)[index] = BOUNDS_BOTTOM(t)[index] = BOUNDS_EMPTY_MAX;
+		return;
+	}
+
+	right = (int32)area->x + area->w;
+	bottom = (int32)area->y + area->h;
+
+	BOUNDS_LEFT(t)[index] = area->x;
+	BOUNDS_TOP(t)[index] = area->y;
+	BOUNDS_RIGHT(t)[index] = (int16)( right > 32767 ? 32767 : right );
+	BOUNDS_BOTTOM(t)[index] = (int16)( bottom > 32767 ? 32767 : bottom );
+}
+
+static uint32 input_insert_bind( uint32 table )
+{
+	BindTable* t = &bind_tables[table];
+	uint32 slot;
+
+	// The caller has reserved room for both the slot and the bind.
+	if ( free_slots_head != BIND_NO_SLOT )
+	{
+		slot = free_slots_head;
+		free_slots_head = bind_slots[slot].index;
+
+		if ( free_slots_head == BIND_NO_SLOT )
+			free_slots_tail = BIND_NO_SLOT;
+	}
+	else
+	{
+		slot = num_slots++;
+		bind_slots[slot].generation = 1;
+	}
+
+	bind_slots[slot].table = (uint16)table;
+	bind_slots[slot].index = t->count;
+
+	memset( &t->records[t->count], 0, sizeof(*t->records) );
+	t->slots[t->count] = slot;
+	t->tags[t->count] = 0;
+	if ( t->shapes != NULL ) t->shapes[t->count] = NULL;
+	if ( t->throttles != NULL ) memset( &t->throttles[t->count], 0, sizeof(*t->throttles) );
+	if ( t->flags != NULL ) t->flags[t->count] = 0;
+	t->count++;
+
+	return slot;
+}
+
+static void input_compact_table( uint32 table )
+{
+	BindTable* t = &bind_tables[table];
+	uint32 i, j, slot;
+
+	// Squeeze out removed records while keeping the order of the rest (it's the order handlers are called in).
+	for ( i = j = 0; i < t->count; i++ )
+	{
+		slot = t->slots[i];
+		if ( slot == BIND_REMOVED ) continue;
+
+		if ( i != j )
+		{
+			t->records[j] = t->records[i];
+			t->slots[j] = slot;
+			t->tags[j] = t->tags[i];
+			bind_slots[slot].index = j;
+
+			if ( t->bounds != NULL )
+			{
+				BOUNDS_LEFT(t)[j] = BOUNDS_LEFT(t)[i];
+				BOUNDS_TOP(t)[j] = BOUNDS_TOP(t)[i];
+				BOUNDS_RIGHT(t)[j] = BOUNDS_RIGHT(t)[i];
+				BOUNDS_BOTTOM(t)[j] = BOUNDS_BOTTOM(t)[i];
+			}
+
+			if ( t->shapes != NULL ) t->shapes[j] = t->shapes[i];
+			if ( t->throttles != NULL ) t->throttles[j] = t->throttles[i];
+			if ( t->flags != NULL ) t->flags[j] = t->flags[i];
+		}
+
+		j++;
+	}
+
+	t->count = j;
+	t->removed = 0;
+
+	// Give memory back when most of the table is no longer needed.
+	if ( t->capacity > 64 && t->count < t->capacity / 4 )
+		input_resize_table( table, t->capacity / 2 );
+}
+
+static void input_compact_if_needed( uint32 table )
+{
+	BindTable* t = &bind_tables[table];
+
+	// Compacting only after half the table has been removed keeps removal O(1) amortized.
+	// Records can't be moved while a dispatch is iterating through them, in that case wait until it's done.
+	if ( dispatch_depth == 0 && t->removed != 0 && t->removed * 2 >= t->count )
+		input_compact_table( table );
+}
+
+static void input_remove_bind( uint32 slot )
+{
+	BindSlot* s = &bind_slots[slot];
+	BindTable* t = &bind_tables[s->table];
+	uint32 table = s->table;
+
+	// Mark the bind removed, it'll be cleaned up by the next compaction.
+	t->slots[s->index] = BIND_REMOVED;
+	t->removed++;
+
+	if ( t->bounds != NULL )
+	{
+		BOUNDS_LEFT(t)[s->index] = BOUNDS_TOP(t)[s->index] = BOUNDS_EMPTY_MIN;
+		BOUNDS_RIGHT(t)[s->index] = BOUNDS_BOTTOM(t)[s->index] = BOUNDS_EMPTY_MAX;
+	}
+
+	if ( t->throttles != NULL )
+		t->throttles[s->index].pending = false;
+
+	if ( t->shapes != NULL && t->shapes[s->index] != NULL )
+	{
+		shape_memory -= t->shapes[s->index]->size;
+		mem_free( t->shapes[s->index] );
+		t->shapes[s->index] = NULL;
+	}
+
+	// Invalidate all existing handles to the slot and append it to the free list. Reusing the oldest free slot
+	// first makes it take as long as possible before a generation comes around again.
+	s->generation = ( s->generation + 1 ) & BIND_GENERATION_MASK;
+	if ( s->generation == 0 ) s->generation = 1;
+
+	s->table = NUM_BIND_TABLES;
+	s->index = BIND_NO_SLOT;
+
+	if ( free_slots_tail != BIND_NO_SLOT )
+		bind_slots[free_slots_tail].index = slot;
+	else
+		free_slots_head = slot;
+
+	free_slots_tail = slot;
+
+	input_compact_if_needed( table );
+}
+
+static void input_begin_dispatch( void )
+{
+	dispatch_depth++;
+}
+
+static void input_end_dispatch( void )
+{
+	uint32 i;
+
+	if ( --dispatch_depth != 0 ) return;
+
+	for ( i = 0; i < NUM_BIND_TABLES; i++ )
+		input_compact_if_needed( i );
+
+	for ( i = 0; i < NUM_INPUT_EVENTS; i++ )
+	{
+		if ( input_hooks[i].removed != 0 ) input_compact_hooks( (INPUT_EVENT)i );
+	}
+}
+
+static KeyBind* input_add_key_bind( uint32 key, keybind_func_t func, void* data, BINDTYPE_KB type )
+{
+	BindRecord* bind;
+	uint32 table, slot, index;
+	uint16 key_index;
+
+	if ( !input_initialized ) return NULL;
+
+	table = input_get_key_table( type );
+	if ( table == NUM_BIND_TABLES ) return NULL;
+
+	key_index = input_intern_key( key );
+	if ( key_index == KEY_INDEX_NONE ) return NULL;
+
+	if ( !input_reserve_slots( 1 ) || !input_reserve_records( table, 1 ) ) return NULL;
+
+	slot = input_insert_bind( table );
+	index = bind_slots[slot].index;
+
+	bind_tables[table].tags[index] = key_index;
+
+	bind = BIND_RECORD( table, index );
+	bind->key_handler = func;
+	bind->userdata = data;
+
+	input_update_listeners();
+
+	return (KeyBind*)input_get_bind_handle( slot );
+}
+
+KeyBind* input_add_char_bind( uint32 key, keybind_func_t func, void* data )
+{
+	return input_add_key_bind( key, func, data, BIND_CHAR );
+}
+
+KeyBind* input_add_key_up_bind( uint32 key, keybind_func_t func, void* data )
+{
+	return input_add_key_bind( key, func, data, BIND_KEYUP );
+}
+
+KeyBind* input_add_key_down_bind( uint32 key, keybind_func_t func, void* data )
+{
+	return input_add_key_bind( key, func, data, BIND_KEYDOWN );
+}
+
+static MouseBind* input_add_mouse_bind( MOUSEBTN button, rectangle_t* area, mousebind_func_t func, void* data, BINDTYPE_MOUSE type )
+{
+	BindRecord* bind;
+	uint32 table, slot, index;
+
+	if ( !input_initialized ) return NULL;
+
+	table = input_get_mouse_table( type );
+	if ( table == NUM_BIND_TABLES ) return NULL;
+
+	if ( !input_reserve_slots( 1 ) || !input_reserve_records( table, 1 ) ) return NULL;
+
+	slot = input_insert_bind( table );
+	index = bind_slots[slot].index;
+
+	input_set_bounds( table, index, area );
+	bind_tables[table].tags[index] = (uint16)( button & TAG_BUTTON_MASK );
+
+	bind = BIND_RECORD( table, index );
+	bind->mouse_handler = func;
+	bind->userdata = data;
+
+	input_update_listeners();
+
+	return (MouseBind*)input_get_bind_handle( slot );
+}
+
+MouseBind* input_add_mouse_move_bind( rectangle_t* area, mousebind_func_t func, void* data )
+{
+	return input_add_mouse_bind( MOUSE_NONE, area, func, data, BIND_MOVE );
+}
+
+MouseBind* input_add_mouse_enter_bind( rectangle_t* area, mousebind_func_t func, void* data )
+{
+	return input_add_mouse_bind( MOUSE_NONE, area, func, data, BIND_ENTER );
+}
+
+MouseBind* input_add_mouse_leave_bind( rectangle_t* area, mousebind_func_t func, void* data )
+{
+	return input_add_mouse_bind( MOUSE_NONE, area, func, data, BIND_LEAVE );
+}
+
+MouseBind* input_add_mousebtn_up_bind( MOUSEBTN button, rectangle_t* area, mousebind_func_t func, void* data )
+{
+	return input_add_mouse_bind( button, area, func, data, BIND_BTNUP );
+}
+
+MouseBind* input_add_mousebtn_down_bind( MOUSEBTN button, rectangle_t* area, mousebind_func_t func, void* data )
+{
+	return input_add_mouse_bind( button, area, func, data, BIND_BTNDOWN );
+}
+
+bool input_add_key_binds( const KeyBindDesc* descs, uint32 count, KeyBind** handles )
+{
+	uint32 i, table, slot, index;
+	uint32 counts[NUM_BIND_TABLES] = { 0 };
+	BindRecord* bind;
+
+	if ( !input_initialized ) return false;
+	if ( count == 0 ) return true;
+
+	// Validate the whole set first so that either all or none of the binds are added.
+	// Interning a key is harmless even if the binds end up not being added.
+	for ( i = 0; i < count; i++ )
+	{
+		table = input_get_key_table( descs[i].type );
+		if ( table == NUM_BIND_TABLES ) return false;
+
+		if ( input_intern_key( descs[i].key ) == KEY_INDEX_NONE ) return false;
+
+		counts[table]++;
+	}
+
+	// Grow every table at most once.
+	if ( !input_reserve_slots( count ) ) return false;
+
+	for ( i = 0; i < NUM_BIND_TABLES; i++ )
+	{
+		if ( counts[i] && !input_reserve_records( i, counts[i] ) ) return false;
+	}
+
+	for ( i = 0; i < count; i++ )
+	{
+		table = input_get_key_table( descs[i].type );
+		slot = input_insert_bind( table );
+		index = bind_slots[slot].index;
+
+		bind_tables[table].tags[index] = input_find_key( descs[i].key );
+
+		bind = BIND_RECORD( table, index );
+		bind->key_handler = descs[i].func;
+		bind->userdata = descs[i].data;
+
+		if ( handles != NULL ) handles[i] = (KeyBind*)input_get_bind_handle( slot );
+	}
+
+	input_update_listeners();
+
+	return true;
+}
+
+bool input_add_mouse_binds( const MouseBindDesc* descs, uint32 count, MouseBind** handles )
+{
+	uint32 i, table, slot, index;
+	uint32 counts[NUM_BIND_TABLES] = { 0 };
+	BindRecord* bind;
+
+	if ( !input_initialized ) return false;
+	if ( count == 0 ) return true;
+
+	for ( i = 0; i < count; i++ )
+	{
+		table = input_get_mouse_table( descs[i].type );
+		if ( table == NUM_BIND_TABLES ) return false;
+
+		counts[table]++;
+	}
+
+	if ( !input_reserve_slots( count ) ) return false;
+
+	for ( i = 0; i < NUM_BIND_TABLES; i++ )
+	{
+		if ( counts[i] && !input_reserve_records( i, counts[i] ) ) return false;
+	}
+
+	for ( i = 0; i < count; i++ )
+	{
+		table = input_get_mouse_table( descs[i].type );
+		slot = input_insert_bind( table );
+		index = bind_slots[slot].index;
+
+		input_set_bounds( table, index, &descs[i].bounds );
+		bind_tables[table].tags[index] = (uint16)( descs[i].button & TAG_BUTTON_MASK );
+
+		bind = BIND_RECORD( table, index );
+		bind->mouse_handler = descs[i].func;
+		bind->userdata = descs[i].data;
+
+		if ( handles != NULL ) handles[i] = (MouseBind*)input_get_bind_handle( slot );
+	}
+
+	input_update_listeners();
+
+	return true;
+}
+
+static void input_remove_key_bind_from_table( uint32 key, keybind_func_t func, BINDTYPE_KB type )
+{
+	BindTable* t;
+	uint32 i, table;
+	uint16 key_index;
+
+	if ( !input_initialized ) return;
+
+	table = input_get_key_table( type );
+	if ( table == NUM_BIND_TABLES ) return;
+
+	key_index = input_find_key( key );
+	if ( key_index == KEY_INDEX_NONE ) return;
+
+	t = &bind_tables[table];
+
+	// Hold off compaction until the whole table has been checked.
+	input_begin_dispatch();
+
+	for ( i = 0; i < t->count; i++ )
+	{
+		if ( t->slots[i] != BIND_REMOVED && ( t->tags[i] & TAG_KEY_MASK ) == key_index && t->records[i].key_handler == func )
+		{
+			input_remove_bind( t->slots[i] );
+		}
+	}
+
+	input_end_dispatch();
+	input_update_listeners();
+}
+
+void input_remove_char_bind( uint32 key, keybind_func_t func )
+{
+	input_remove_key_bind_from_table( key, func, BIND_CHAR );
+}
+
+void input_remove_key_up_bind( uint32 key, keybind_func_t func )
+{
+	input_remove_key_bind_from_table( key, func, BIND_KEYUP );
+}
+
+void input_remove_key_down_bind( uint32 key, keybind_func_t func )
+{
+	input_remove_key_bind_from_table( key, func, BIND_KEYDOWN );
+}
+
+void input_remove_key_bind( KeyBind* bind )
+{
+	input_remove_key_binds( &bind, 1 );
+}
+
+static void input_remove_mouse_bind_from_table( MOUSEBTN button, mousebind_func_t func, BINDTYPE_MOUSE type )
+{
+	BindTable* t;
+	uint32 i, table;
+
+	if ( !input_initialized ) return;
+
+	table = input_get_mouse_table( type );
+	if ( table == NUM_BIND_TABLES ) return;
+
+	t = &bind_tables[table];
+
+	// Hold off compaction until the whole table has been checked.
+	input_begin_dispatch();
+
+	for ( i = 0; i < t->count; i++ )
+	{
+		if ( t->slots[i] != BIND_REMOVED && (MOUSEBTN)( t->tags[i] & TAG_BUTTON_MASK ) == button &&
+			 t->records[i].mouse_handler == func )
+		{
+			input_remove_bind( t->slots[i] );
+		}
+	}
+
+	input_end_dispatch();
+	input_update_listeners();
+}
+
+void input_remove_mouse_move_bind( mousebind_func_t func )
+{
+	input_remove_mouse_bind_from_table( MOUSE_NONE, func, BIND_MOVE );
+}
+
+void input_remove_mouse_enter_bind( mousebind_func_t func )
+{
+	input_remove_mouse_bind_from_table( MOUSE_NONE, func, BIND_ENTER );
+}
+
+void input_remove_mouse_leave_bind( mousebind_func_t func )
+{
+	input_remove_mouse_bind_from_table( MOUSE_NONE, func, BIND_LEAVE );
+}
+
+void input_remove_mousebtn_up_bind( MOUSEBTN button, mousebind_func_t func )
+{
+	input_remove_mouse_bind_from_table( button, func, BIND_BTNUP );
+}
+
+void input_remove_mousebtn_down_bind( MOUSEBTN button, mousebind_func_t func )
+{
+	input_remove_mouse_bind_from_table( button, func, BIND_BTNDOWN );
+}
+
+void input_remove_mouse_bind( MouseBind* bind )
+{
+	input_remove_mouse_binds( &bind, 1 );
+}
+
+void input_remove_key_binds( KeyBind** binds, uint32 count )
+{
+	uint32 i, slot;
+
+	if ( !input_initialized ) return;
+
+	// Stale or already removed handles are simply ignored. The tables are compacted once at the end.
+	input_begin_dispatch();
+
+	for ( i = 0; i < count; i++ )
+	{
+		slot = input_resolve_bind_handle( binds[i], 0, FIRST_MOUSE_TABLE - 1 );
+		if ( slot != BIND_NO_SLOT ) input_remove_bind( slot );
+	}
+
+	input_end_dispatch();
+	input_update_listeners();
+}
+
+void input_remove_mouse_binds( MouseBind** binds, uint32 count )
+{
+	uint32 i, slot;
+
+	if ( !input_initialized ) return;
+
+	input_begin_dispatch();
+
+	for ( i = 0; i < count; i++ )
+	{
+		slot = input_resolve_bind_handle( binds[i], FIRST_MOUSE_TABLE, NUM_BIND_TABLES - 1 );
+		if ( slot != BIND_NO_SLOT ) input_remove_bind( slot );
+	}
+
+	input_end_dispatch();
+	input_update_listeners();
+}
+
+void input_set_mousebind_button( MouseBind* handle, MOUSEBTN button )
+{
+	uint32 table, index;
+	uint16* tag;
+
+	if ( !input_get_mouse_bind( handle, &table, &index ) ) return;
+
+	tag = &bind_tables[table].tags[index];
+	*tag = (uint16)( ( *tag & ~TAG_BUTTON_MASK ) | ( button & TAG_BUTTON_MASK ) );
+}
+
+static bool input_is_point_in_shape( const HitShape* shape, int16 x, int16 y )
+{
+	uint32 col, row;
+	int64 dx, dy, w, h;
+
+	col = (uint32)( x - shape->x );
+	row = (uint32)( y - shape->y );
+
+	if ( col >= shape->width || row >= shape->height ) return false;
+
+	if ( shape->type == HITSHAPE_MASK )
+		return ( HITSHAPE_BITS( shape )[row * shape->stride + ( col >> 5 )] >> ( col & 31 ) ) & 1;
+
+	// Compare (dx / (w/2))^2 + (dy / (h/2))^2 <= 1 with everything multiplied out, doubled to stay in integers.
+	w = shape->width - 1;
+	h = shape->height - 1;
+	dx = 2 * (int64)col - w;
+	dy = 2 * (int64)row - h;
+
+	return (uint64)( dx * dx ) * (uint64)( h * h ) + (uint64)( dy * dy ) * (uint64)( w * w ) <= (uint64)( w * w ) * (uint64)( h * h );
+}
+
+static bool input_is_point_in_bind( uint32 table, uint32 index, int16 x, int16 y )
+{
+	const BindTable* t = &bind_tables[table];
+
+	if ( x < BOUNDS_LEFT(t)[index] || x > BOUNDS_RIGHT(t)[index] ||
+		 y < BOUNDS_TOP(t)[index] || y > BOUNDS_BOTTOM(t)[index] )
+		return false;
+
+	return t->shapes == NULL || t->shapes[index] == NULL || input_is_point_in_shape( t->shapes[index], x, y );
+}
+
+static bool input_update_hover( uint32 table, uint32 index, bool inside, int16 x, int16 y )
+{
+	uint16* tag = &bind_tables[table].tags[index];
+	BindRecord* bind;
+	bool ret;
+
+	if ( inside == ( ( *tag & TAG_HOVERED ) != 0 ) ) return true;
+
+	*tag ^= TAG_HOVERED;
+
+	// Enter binds are only interested in the cursor coming in and leave binds in it going out.
+	if ( inside != ( table == TABLE_ENTER ) ) return true;
+
+	bind = BIND_RECORD( table, index );
+
+	INPUT_TRACE_BEGIN( "hover bind", inside );
+	ret = bind->mouse_handler( MOUSE_NONE, x, y, bind->userdata );
+	INPUT_TRACE_END();
+
+	return ret;
+}
+
+static void input_set_shape( uint32 table, uint32 index, HitShape* shape )
+{
+	BindTable* t = &bind_tables[table];
+
+	// The shape array only exists once the table has a shaped bind, tables of rectangles don't pay for it.
+	if ( t->shapes == NULL )
+	{
+		if ( shape == NULL ) return;
+
+		t->shapes = mem_alloc( t->capacity * sizeof(*t->shapes) );
+		memset( t->shapes, 0, t->capacity * sizeof(*t->shapes) );
+	}
+
+	if ( t->shapes[index] != NULL )
+	{
+		shape_memory -= t->shapes[index]->size;
+		mem_free( t->shapes[index] );
+	}
+
+	t->shapes[index] = shape;
+
+	if ( shape != NULL ) shape_memory += shape->size;
+
+	input_track_memory();
+}
+
+static HitShape* input_create_shape( HITSHAPE type, int32 x, int32 y, uint32 width, uint32 height )
+{
+	HitShape* shape;
+	uint32 stride, size;
+
+	if ( width == 0 || height == 0 || width > 0xFFFF || height > 0xFFFF ) return NULL;
+	if ( type == HITSHAPE_MASK && width * height > HITSHAPE_MAX_PIXELS ) return NULL;
+
+	stride = ( type == HITSHAPE_MASK ) ? ( width + 31 ) / 32 : 0;
+	size = sizeof(HitShape) + stride * height * sizeof(uint32);
+
+	shape = mem_alloc( size );
+	memset( shape, 0, size );
+
+	shape->type = (uint8)type;
+	shape->x = (int16)x;
+	shape->y = (int16)y;
+	shape->width = (uint16)width;
+	shape->height = (uint16)height;
+	shape->stride = stride;
+	shape->size = size;
+
+	return shape;
+}
+
+static void input_update_bind_area( uint32 table, uint32 index )
+{
+	bounds_serial++;
+
+	// The cursor may have entered or left the bind without moving.
+	if ( table == TABLE_ENTER || table == TABLE_LEAVE )
+	{
+		input_begin_dispatch();
+		input_update_hover( table, index, input_is_point_in_bind( table, index, mouse_x, mouse_y ), mouse_x, mouse_y );
+		input_end_dispatch();
+	}
+}
+
+void input_set_mousebind_rect( MouseBind* handle, rectangle_t* area )
+{
+	uint32 table, index;
+
+	if ( !input_get_mouse_bind( handle, &table, &index ) ) return;
+
+	input_set_bounds( table, index, area );
+	input_set_shape( table, index, NULL );
+	input_update_bind_area( table, index );
+}
+
+static int32 input_round_up( double value )
+{
+	int32 ret = (int32)value;
+
+	// The cast rounds towards zero, which is already up for negative values.
+	if ( (double)ret < value ) ret++;
+
+	return ret;
+}
+
+static void input_set_shape_bounds( uint32 table, uint32 index, const HitShape* shape )
+{
+	rectangle_t area;
+
+	area.x = shape->x;
+	area.y = shape->y;
+	area.w = (int16)( shape->width - 1 );
+	area.h = (int16)( shape->height - 1 );
+
+	input_set_bounds( table, index, &area );
+}
+
+bool input_set_mousebind_ellipse( MouseBind* handle, rectangle_t* area )
+{
+	HitShape* shape;
+	uint32 table, index;
+
+	if ( !input_get_mouse_bind( handle, &table, &index ) ) return false;
+	if ( area->w < 0 || area->h < 0 ) return false;
+
+	// The ellipse is tested as is, it doesn't need a mask.
+	shape = input_create_shape( HITSHAPE_ELLIPSE, area->x, area->y, (uint32)area->w + 1, (uint32)area->h + 1 );
+	if ( shape == NULL ) return false;
+
+	input_set_bounds( table, index, area );
+	input_set_shape( table, index, shape );
+	input_update_bind_area( table, index );
+
+	return true;
+}
+
+bool input_set_mousebind_polygon( MouseBind* handle, const int16* points, uint32 count )
+{
+	HitShape* shape;
+	uint32 table, index, i, j, k, row, num_crossings;
+	int32 left, top, right, bottom, col, first, last;
+	int32 x0, y0, x1, y1, py;
+	double* crossings;
+	double crossing;
+
+	if ( !input_get_mouse_bind( handle, &table, &index ) ) return false;
+	if ( points == NULL || count < 3 ) return false;
+
+	left = right = points[0];
+	top = bottom = points[1];
+
+	for ( i = 1; i < count; i++ )
+	{
+		if ( points[2*i] < left ) left = points[2*i];
+		if ( points[2*i] > right ) right = points[2*i];
+		if ( points[2*i+1] < top ) top = points[2*i+1];
+		if ( points[2*i+1] > bottom ) bottom = points[2*i+1];
+	}
+
+	shape = input_create_shape( HITSHAPE_MASK, left, top, (uint32)( right - left + 1 ), (uint32)( bottom - top + 1 ) );
+	if ( shape == NULL ) return false;
+
+	crossings = mem_alloc( count * sizeof(*crossings) );
+
+	// The polygon is rasterized into a mask once here, so the test on dispatch is a single bit lookup.
+	// Each row is filled between pairs of edge crossings (even-odd rule), sampling at the pixel coordinates.
+	for ( row = 0; row < shape->height; row++ )
+	{
+		py = top + (int32)row;
+		num_crossings = 0;
+
+		for ( i = 0, j = count - 1; i < count; j = i++ )
+		{
+			x0 = points[2*j]; y0 = points[2*j+1];
+			x1 = points[2*i]; y1 = points[2*i+1];
+
+			if ( ( y0 <= py ) == ( y1 <= py ) ) continue;
+
+			crossing = x0 + (double)( py - y0 ) * ( x1 - x0 ) / ( y1 - y0 );
+
+			// Keep the crossings sorted, a row rarely has more than a few.
+			for ( k = num_crossings; k > 0 && crossings[k-1] > crossing; k-- )
+				crossings[k] = crossings[k-1];
+
+			crossings[k] = crossing;
+			num_crossings++;
+		}
+
+		for ( i = 0; i + 1 < num_crossings; i += 2 )
+		{
+			// Pixels from the first crossing up to (but not including) the second one are inside.
+			first = input_round_up( crossings[i] ) - left;
+			last = input_round_up( crossings[i+1] ) - left - 1;
+
+			for ( col = first < 0 ? 0 : first; col <= last && col < (int32)shape->width; col++ )
+				HITSHAPE_BITS( shape )[row * shape->stride + ( col >> 5 )] |= 1u << ( col & 31 );
+		}
+	}
+
+	mem_free( crossings );
+
+	input_set_shape_bounds( table, index, shape );
+	input_set_shape( table, index, shape );
+	input_update_bind_area( table, index );
+
+	return true;
+}
+
+bool input_set_mousebind_mask( MouseBind* handle, int16 x, int16 y, uint16 width, uint16 height, const uint8* mask, uint32 pitch )
+{
+	HitShape* shape;
+	uint32 table, index, row, col;
+
+	if ( !input_get_mouse_bind( handle, &table, &index ) ) return false;
+	if ( mask == NULL || pitch < width ) return false;
+
+	shape = input_create_shape( HITSHAPE_MASK, x, y, width, height );
+	if ( shape == NULL ) return false;
+
+	// Packed down to a bit per pixel, that's an eighth of the application's mask.
+	for ( row = 0; row < height; row++ )
+	{
+		for ( col = 0; col < width; col++ )
+		{
+			if ( mask[row * pitch + col] != 0 )
+				HITSHAPE_BITS( shape )[row * shape->stride + ( col >> 5 )] |= 1u << ( col & 31 );
+		}
+	}
+
+	input_set_shape_bounds( table, index, shape );
+	input_set_shape( table, index, shape );
+	input_update_bind_area( table, index );
+
+	return true;
+}
+
+void input_set_mousebind_func( MouseBind* handle, mousebind_func_t func )
+{
+	uint32 table, index;
+
+	if ( !input_get_mouse_bind( handle, &table, &index ) ) return;
+	BIND_RECORD( table, index )->mouse_handler = func;
+}
+
+void input_set_mousebind_param( MouseBind* handle, void* data )
+{
+	uint32 table, index;
+
+	if ( !input_get_mouse_bind( handle, &table, &index ) ) return;
+	BIND_RECORD( table, index )->userdata = data;
+}
+
+void input_block_keys( bool block )
+{
+	block_keys = block;
+}
+
+bool input_is_cursor_showing( void )
+{
+	return show_cursor;
+}
+
+void input_get_cursor_pos( int16* x, int16* y )
+{
+	*x = mouse_x;
+	*y = mouse_y;
+}
+
+bool input_is_pointer_locked( void )
+{
+	return pointer_locked;
+}
+
+void input_set_event_state( uint32 modifiers, uint32 buttons )
+{
+	input_modifiers = (uint8)modifiers;
+	input_buttons = (uint8)buttons;
+}
+
+uint32 input_get_modifiers( void )
+{
+	return input_modifiers;
+}
+
+uint32 input_get_mouse_buttons( void )
+{
+	return input_buttons;
+}
+
+uint64 input_get_time( void )
+{
+	return input_platform_get_time();
+}
+
+static bool input_call_hooks( INPUT_EVENT type, InputEvent* event )
+{
+	InputHook* hook;
+	uint32 i, count;
+	bool ret = true;
+
+	input_begin_dispatch();
+
+	// Hooks added by the handlers will only be called on the next event.
+	count = input_hooks[type].count;
+
+	for ( i = 0; i < count; i++ )
+	{
+		hook = &input_hooks[type].hooks[i];
+
+		INPUT_TRACE_BEGIN( "hook", type );
+
+		if ( hook->handler != NULL )
+		{
+			if ( !hook->handler( event ) ) ret = false;
+		}
+		else if ( hook->data_handler != NULL )
+		{
+			if ( !hook->data_handler( event, hook->userdata ) ) ret = false;
+		}
+
+		INPUT_TRACE_END();
+
+		if ( !ret ) break;
+	}
+
+	input_end_dispatch();
+
+	return ret;
+}
+
+static bool input_has_hooks( INPUT_EVENT type )
+{
+	return input_hooks[type].count != input_hooks[type].removed;
+}
+
+bool input_handle_keyboard_event( INPUT_EVENT type, uint32 key )
+{
+	InputEvent event;
+
+	if ( !input_initialized ) return true;
+	if ( type >= NUM_INPUT_EVENTS ) return true;
+
+	if ( !input_has_hooks( type ) ) return true;
+
+	event.type = type;
+	event.modifiers = input_modifiers;
+	event.buttons = input_buttons;
+	event.keyboard.key = key;
+
+	if ( !input_call_hooks( type, &event ) )
+		return false;
+
+	if ( block_keys )
+	{
+		keys_blocked = true;
+		return false;
+	}
+
+	return true;
+}
+
+bool input_handle_mouse_event( INPUT_EVENT type, int16 x, int16 y, MOUSEBTN button, MOUSEWHEEL wheel )
+{
+	InputEvent event;
+
+	if ( !input_initialized ) return true;
+	if ( type >= NUM_INPUT_EVENTS ) return true;
+
+	event.type = type;
+	event.modifiers = input_modifiers;
+	event.buttons = input_buttons;
+	event.mouse.x = x;
+	event.mouse.y = y;
+	event.mouse.dx = x - mouse_x;
+	event.mouse.dy = y - mouse_y;
+	event.mouse.button = (uint8)button;
+	event.mouse.wheel = (uint8)wheel;
+
+	// Keep track of the cursor even when nothing hooks the event, hover binds depend on it.
+	mouse_x = x;
+	mouse_y = y;
+
+	input_predict_sample( x, y, dispatch_time );
+
+	if ( !input_has_hooks( type ) ) return true;
+
+	return input_call_hooks( type, &event );
+}
+
+bool input_handle_relative_mouse_event( int16 dx, int16 dy )
+{
+	InputEvent event;
+
+	if ( !input_initialized ) return true;
+
+	if ( !input_has_hooks( INPUT_MOUSE_MOVE ) ) return true;
+
+	// The cursor is frozen while the pointer is locked, only the delta changes.
+	event.type = INPUT_MOUSE_MOVE;
+	event.modifiers = input_modifiers;
+	event.buttons = input_buttons;
+	event.mouse.x = mouse_x;
+	event.mouse.y = mouse_y;
+	event.mouse.dx = dx;
+	event.mouse.dy = dy;
+	event.mouse.button = MOUSE_NONE;
+	event.mouse.wheel = MWHEEL_STATIONARY;
+
+	return input_call_hooks( INPUT_MOUSE_MOVE, &event );
+}
+
+void input_set_keybind_focusable( KeyBind* handle, bool focusable )
+{
+	uint32 table, index;
+
+	if ( !input_get_key_bind( handle, &table, &index ) ) return;
+
+	if ( focusable ) bind_tables[table].tags[index] |= TAG_FOCUSABLE;
+	else bind_tables[table].tags[index] &= ~TAG_FOCUSABLE;
+}
+
+bool input_set_key_focus( KeyBind** chain, uint32 count )
+{
+	uint32 i;
+
+	if ( count > INPUT_MAX_FOCUS_CHAIN ) return false;
+
+	// The handles are copied, a bind removed later simply drops out of the chain.
+	for ( i = 0; i < count; i++ )
+		focus_chain[i] = chain[i];
+
+	focus_count = count;
+
+	return true;
+}
+
+static void input_set_bind_flag( uint32 table, uint32 index, uint8 flag, bool set )
+{
+	BindTable* t = &bind_tables[table];
+
+	// Tables without flagged binds don't carry the flags around.
+	if ( t->flags == NULL )
+	{
+		if ( !set ) return;
+
+		t->flags = mem_alloc( t->capacity * sizeof(*t->flags) );
+		memset( t->flags, 0, t->capacity * sizeof(*t->flags) );
+
+		input_track_memory();
+	}
+
+	if ( set ) t->flags[index] |= flag;
+	else t->flags[index] &= ~flag;
+}
+
+void input_set_keybind_parallel( KeyBind* handle, bool parallel )
+{
+	uint32 table, index;
+
+	if ( !input_get_key_bind( handle, &table, &index ) ) return;
+
+	input_set_bind_flag( table, index, BIND_FLAG_PARALLEL, parallel );
+}
+
+static void input_reserve_jobs( uint32 count )
+{
+	uint32 capacity;
+
+	if ( count <= jobs_capacity ) return;
+
+	capacity = jobs_capacity ? jobs_capacity : HIT_TEST_BLOCK;
+	while ( capacity < count ) capacity *= 2;
+
+	parallel_jobs = mem_realloc( parallel_jobs, capacity * sizeof(*parallel_jobs) );
+	jobs_capacity = capacity;
+
+	input_track_memory();
+}
+
+static uint32 input_begin_key_jobs( uint32 table, uint32 key, uint16 key_index, bool match_key )
+{
+	BindTable* t = &bind_tables[table];
+	uint32 i, count = 0;
+
+	input_reserve_jobs( t->count );
+
+	// The handlers are copied, the workers never look at the tables which the dispatching thread may change.
+	for ( i = 0; i < t->count; i++ )
+	{
+		if ( !( t->flags[i] & BIND_FLAG_PARALLEL ) ) continue;
+		if ( match_key ? t->tags[i] != key_index : ( t->tags[i] & TAG_FOCUSABLE ) != 0 ) continue;
+		if ( t->slots[i] == BIND_REMOVED ) continue;
+
+		parallel_jobs[count].key_handler = t->records[i].key_handler;
+		parallel_jobs[count].mouse_handler = NULL;
+		parallel_jobs[count].userdata = t->records[i].userdata;
+		count++;
+	}
+
+	if ( count != 0 )
+		input_begin_jobs( parallel_jobs, count, key, MOUSE_NONE, 0, 0 );
+
+	return count;
+}
+
+static bool input_handle_focus_binds( uint32 table, uint32 key, uint16 key_index, bool match_key )
+{
+	BindRecord* bind;
+	uint32 i, bind_table, index;
+
+	for ( i = 0; i < focus_count; i++ )
+	{
+		if ( !input_get_key_bind( focus_chain[i], &bind_table, &index ) ) continue;
+		if ( bind_table != table ) continue;
+
+		// Binds that aren't focusable are global and get the event from the table like everyone else.
+		if ( !( bind_tables[table].tags[index] & TAG_FOCUSABLE ) ) continue;
+		if ( match_key && ( bind_tables[table].tags[index] & TAG_KEY_MASK ) != key_index ) continue;
+
+		bind = BIND_RECORD( table, index );
+
+		INPUT_TRACE_BEGIN( "focus bind", key );
+
+		// Consuming the event stops it from going any further up the chain, or to the global binds.
+		if ( !bind->key_handler( key, bind->userdata ) )
+		{
+			INPUT_TRACE_END();
+			return false;
+		}
+
+		INPUT_TRACE_END();
+	}
+
+	return true;
+}
+
+static bool input_handle_key_binds( uint32 table, uint32 key, bool match_key )
+{
+	BindTable* t = &bind_tables[table];
+	BindRecord* bind;
+	uint32 i, count, num_jobs = 0;
+	uint16 key_index = KEY_INDEX_NONE;
+	bool ret = true;
+
+	if ( !input_initialized ) return true;
+
+	// A key that hasn't been interned has never been bound, so there's nothing to call.
+	if ( match_key )
+	{
+		key_index = input_find_key( key );
+		if ( key_index == KEY_INDEX_NONE ) return true;
+	}
+
+	input_begin_dispatch();
+
+	if ( focus_count != 0 && !input_handle_focus_binds( table, key, key_index, match_key ) )
+	{
+		input_end_dispatch();
+		return false;
+	}
+
+	// Parallel binds are handed to the workers first so that they run while the rest are being called.
+	if ( t->flags != NULL && input_has_workers() )
+		num_jobs = input_begin_key_jobs( table, key, key_index, match_key );
+
+	// Binds added by the handlers will only be called on the next event. The arrays may be reallocated
+	// by a handler, so they have to be looked up again on every iteration.
+	count = t->count;
+
+	for ( i = 0; i < count; i++ )
+	{
+		// Only the tags are looked at until a match is found. Focusable binds never match a key index,
+		// their tags have TAG_FOCUSABLE set.
+		if ( match_key ? t->tags[i] != key_index : ( t->tags[i] & TAG_FOCUSABLE ) != 0 ) continue;
+		if ( t->slots[i] == BIND_REMOVED ) continue;
+		if ( num_jobs != 0 && ( t->flags[i] & BIND_FLAG_PARALLEL ) ) continue;
+
+		bind = BIND_RECORD( table, i );
+
+		INPUT_TRACE_BEGIN( "key bind", key );
+		if ( !bind->key_handler( key, bind->userdata ) ) ret = false;
+		INPUT_TRACE_END();
+	}
+
+	if ( num_jobs != 0 )
+	{
+		INPUT_TRACE_BEGIN( "parallel binds", num_jobs );
+		if ( !input_finish_jobs() ) ret = false;
+		INPUT_TRACE_END();
+	}
+
+	input_end_dispatch();
+
+	return ret;
+}
+
+bool input_handle_char_bind( uint32 key )
+{
+	return input_handle_key_binds( TABLE_CHAR, key, false );
+}
+
+bool input_handle_key_down_bind( uint32 key )
+{
+	return input_handle_key_binds( TABLE_KEYDOWN, key, true );
+}
+
+bool input_handle_key_up_bind( uint32 key )
+{
+	return input_handle_key_binds( TABLE_KEYUP, key, true );
+}
+
+#if defined(INPUT_HIT_TEST_AVX2)
+
+static uint32 input_hit_test_block( const BindTable* t, uint32 first, int16 x, int16 y )
+{
+	__m256i px = _mm256_set1_epi16( x );
+	__m256i py = _mm256_set1_epi16( y );
+	__m256i miss;
+	__m128i lanes;
+
+	miss = _mm256_cmpgt_epi16( _mm256_loadu_si256( (const __m256i*)( BOUNDS_LEFT(t) + first ) ), px );
+	miss = _mm256_or_si256( miss, _mm256_cmpgt_epi16( px, _mm256_loadu_si256( (const __m256i*)( BOUNDS_RIGHT(t) + first ) ) ) );
+	miss = _mm256_or_si256( miss, _mm256_cmpgt_epi16( _mm256_loadu_si256( (const __m256i*)( BOUNDS_TOP(t) + first ) ), py ) );
+	miss = _mm256_or_si256( miss, _mm256_cmpgt_epi16( py, _mm256_loadu_si256( (const __m256i*)( BOUNDS_BOTTOM(t) + first ) ) ) );
+
+	// Pack the 16-bit lanes into bytes to get one bit per bind out of movemask.
+	lanes = _mm_packs_epi16( _mm256_castsi256_si128( miss ), _mm256_extracti128_si256( miss, 1 ) );
+
+	return ~(uint32)_mm_movemask_epi8( lanes ) & 0xFFFF;
+}
+
+#elif defined(INPUT_HIT_TEST_SSE2)
+
+static uint32 input_hit_test_8( const BindTable* t, uint32 first, __m128i px, __m128i py )
+{
+	__m128i miss;
+
+	miss = _mm_cmpgt_epi16( _mm_loadu_si128( (const __m128i*)( BOUNDS_LEFT(t) + first ) ), px );
+	miss = _mm_or_si128( miss, _mm_cmpgt_epi16( px, _mm_loadu_si128( (const __m128i*)( BOUNDS_RIGHT(t) + first ) ) ) );
+	miss = _mm_or_si128( miss, _mm_cmpgt_epi16( _mm_loadu_si128( (const __m128i*)( BOUNDS_TOP(t) + first ) ), py ) );
+	miss = _mm_or_si128( miss, _mm_cmpgt_epi16( py, _mm_loadu_si128( (const __m128i*)( BOUNDS_BOTTOM(t) + first ) ) ) );
+
+	return ~(uint32)_mm_movemask_epi8( _mm_packs_epi16( miss, miss ) ) & 0xFF;
+}
+
+static uint32 input_hit_test_block( const BindTable* t, uint32 first, int16 x, int16 y )
+{
+	__m128i px = _mm_set1_epi16( x );
+	__m128i py = _mm_set1_epi16( y );
+
+	return input_hit_test_8( t, first, px, py ) | ( input_hit_test_8( t, first + 8, px, py ) << 8 );
+}
+
+#else
+
+static uint32 input_hit_test_block( const BindTable* t, uint32 first, int16 x, int16 y )
+{
+	uint32 i, hits = 0;
+
+	for ( i = 0; i < HIT_TEST_BLOCK; i++ )
+	{
+		if ( x >= BOUNDS_LEFT(t)[first + i] && x <= BOUNDS_RIGHT(t)[first + i] &&
+			 y >= BOUNDS_TOP(t)[first + i] && y <= BOUNDS_BOTTOM(t)[first + i] )
+		{
+			hits |= 1 << i;
+		}
+	}
+
+	return hits;
+}
+
+#endif
+
+static uint32 input_hit_test( uint32 table, uint32 first, uint32 count, int16 x, int16 y )
+{
+	const BindTable* t = &bind_tables[table];
+	uint32 hits, bits, i;
+
+	// The block never goes past the capacity, but entries past the count are leftovers and must be ignored.
+	hits = input_hit_test_block( t, first, x, y );
+	if ( count - first < HIT_TEST_BLOCK ) hits &= ( 1 << ( count - first ) ) - 1;
+
+	// Shaped binds are only looked at more closely when the point is within their bounds.
+	if ( t->shapes != NULL )
+	{
+		for ( i = 0, bits = hits; bits != 0; i++, bits >>= 1 )
+		{
+			if ( ( bits & 1 ) && t->shapes[first + i] != NULL && !input_is_point_in_shape( t->shapes[first + i], x, y ) )
+				hits &= ~( 1u << i );
+		}
+	}
+
+	return hits;
+}
+
+static bool input_throttle_due( const BindThrottle* throttle, uint64 now )
+{
+	// A time before the last call is treated as being within the interval rather than wrapping around.
+	return now >= throttle->last_call && now - throttle->last_call >= throttle->interval;
+}
+
+static bool input_throttle_bind( uint32 table, uint32 index, int16 x, int16 y )
+{
+	BindThrottle* throttle;
+	uint64 now;
+
+	if ( bind_tables[table].throttles == NULL || bind_tables[table].throttles[index].interval == 0 ) return true;
+
+	throttle = &bind_tables[table].throttles[index];
+
+	// Calls are limited by when they're made, not by when the event happened, so that this and the trailing
+	// calls of input_flush_throttled go by the same clock. Queued and threaded events can be well behind it.
+	now = input_platform_get_time();
+
+	// A throttled bind called too soon only remembers the position, input_flush_throttled delivers it later.
+	if ( !input_throttle_due( throttle, now ) )
+	{
+		throttle->x = x;
+		throttle->y = y;
+		throttle->pending = true;
+		return false;
+	}
+
+	throttle->last_call = now;
+	throttle->pending = false;
+
+	return true;
+}
+
+static bool input_call_mouse_handler( uint32 table, uint32 index, MOUSEBTN button, int16 x, int16 y )
+{
+	BindRecord* bind;
+	bool ret;
+
+	if ( !input_throttle_bind( table, index, x, y ) ) return true;
+
+	bind = BIND_RECORD( table, index );
+
+	INPUT_TRACE_BEGIN( "mouse bind", button );
+	ret = bind->mouse_handler( button, x, y, bind->userdata );
+	INPUT_TRACE_END();
+
+	return ret;
+}
+
+static uint32 input_begin_mouse_jobs( uint32 table, MOUSEBTN button, int16 x, int16 y )
+{
+	BindTable* t = &bind_tables[table];
+	uint32 i, base, hits, count = 0;
+
+	input_reserve_jobs( t->count );
+
+	for ( base = 0; base < t->count; base += HIT_TEST_BLOCK )
+	{
+		hits = input_hit_test( table, base, t->count, x, y );
+
+		for ( i = base; hits != 0; i++, hits >>= 1 )
+		{
+			if ( !( hits & 1 ) ) continue;
+
+			if ( !( t->flags[i] & BIND_FLAG_PARALLEL ) ) continue;
+			if ( t->slots[i] == BIND_REMOVED ) continue;
+			if ( table != TABLE_MOVE && (MOUSEBTN)( t->tags[i] & TAG_BUTTON_MASK ) != button ) continue;
+			if ( !input_throttle_bind( table, i, x, y ) ) continue;
+
+			parallel_jobs[count].key_handler = NULL;
+			parallel_jobs[count].mouse_handler = t->records[i].mouse_handler;
+			parallel_jobs[count].userdata = t->records[i].userdata;
+			count++;
+		}
+	}
+
+	if ( count != 0 )
+		input_begin_jobs( parallel_jobs, count, 0, button, x, y );
+
+	return count;
+}
+
+static bool input_handle_mouse_binds( uint32 table, MOUSEBTN button, int16 x, int16 y )
+{
+	BindTable* t = &bind_tables[table];
+	uint32 i, base, count, hits, serial, num_jobs = 0;
+	bool ret = true;
+
+	// Parallel binds are hit tested and handed to the workers before the rest are called.
+	if ( t->flags != NULL && input_has_workers() )
+		num_jobs = input_begin_mouse_jobs( table, button, x, y );
+
+	count = t->count;
+
+	for ( base = 0; base < count; base += HIT_TEST_BLOCK )
+	{
+		hits = input_hit_test( table, base, count, x, y );
+
+		for ( i = base; hits != 0; i++, hits >>= 1 )
+		{
+			if ( !( hits & 1 ) ) continue;
+
+			if ( t->slots[i] == BIND_REMOVED ) continue;
+			if ( table != TABLE_MOVE && (MOUSEBTN)( t->tags[i] & TAG_BUTTON_MASK ) != button ) continue;
+			if ( num_jobs != 0 && ( t->flags[i] & BIND_FLAG_PARALLEL ) ) continue;
+
+			serial = bounds_serial;
+
+			if ( !input_call_mouse_handler( table, i, button, x, y ) )
+				ret = false;
+
+			// The handler moved some binds around, test the rest of the block again.
+			if ( serial != bounds_serial )
+				hits = input_hit_test( table, base, count, x, y ) >> ( i - base );
 		}
 	}
 
+	if ( num_jobs != 0 )
+	{
+		INPUT_TRACE_BEGIN( "parallel binds", num_jobs );
+		if ( !input_finish_jobs() ) ret = false;
+		INPUT_TRACE_END();
+	}
+
 	return ret;
 }
 
-bool input_handle_key_down_bind( uint32 key )
+static bool input_handle_hover_binds( uint32 table, int16 x, int16 y )
 {
-	KeyBind* bind;
-	node_t *node, *tmp;
+	uint32 i, base, count, hits, serial;
 	bool ret = true;
 
-	if ( !input_initialized ) return true;
+	count = bind_tables[table].count;
 
-	list_foreach_safe( key_down_binds, node, tmp )
+	for ( base = 0; base < count; base += HIT_TEST_BLOCK )
 	{
-		bind = (KeyBind*)node;
-		if ( key == bind->key )
+		hits = input_hit_test( table, base, count, x, y );
+
+		for ( i = base; i < count && i < base + HIT_TEST_BLOCK; i++ )
 		{
-			if ( !bind->handler( key, bind->userdata ) ) ret = false;
+			if ( bind_tables[table].slots[i] == BIND_REMOVED ) continue;
+
+			serial = bounds_serial;
+
+			if ( !input_update_hover( table, i, ( hits >> ( i - base ) ) & 1, x, y ) ) ret = false;
+
+			if ( serial != bounds_serial )
+				hits = input_hit_test( table, base, count, x, y );
 		}
 	}
 
 	return ret;
 }
 
-bool input_handle_key_up_bind( uint32 key )
+static bool input_call_mouse_bind( MouseBind* handle, MOUSEBTN button, int16 x, int16 y, bool* called )
 {
-	KeyBind* bind;
-	node_t *node, *tmp;
-	bool ret = true;
+	uint32 table, index;
 
-	if ( !input_initialized ) return true;
+	*called = false;
+
+	if ( !input_get_mouse_bind( handle, &table, &index ) ) return true;
+
+	*called = true;
+
+	return input_call_mouse_handler( table, index, button, x, y );
+}
+
+bool input_set_mousebind_interval( MouseBind* handle, uint64 interval_ns )
+{
+	BindTable* t = &bind_tables[TABLE_MOVE];
+	uint32 table, index;
+
+	if ( !input_get_mouse_bind( handle, &table, &index ) ) return false;
+	if ( table != TABLE_MOVE ) return false;
+
+	// Tables without throttled binds don't carry the state around.
+	if ( t->throttles == NULL )
+	{
+		if ( interval_ns == 0 ) return true;
+
+		t->throttles = mem_alloc( t->capacity * sizeof(*t->throttles) );
+		memset( t->throttles, 0, t->capacity * sizeof(*t->throttles) );
+
+		input_track_memory();
+	}
 
-	list_foreach_safe( key_up_binds, node, tmp )
+	t->throttles[index].interval = interval_ns;
+	t->throttles[index].last_call = 0;
+	t->throttles[index].pending = false;
+
+	return true;
+}
+
+void input_set_mousebind_parallel( MouseBind* handle, bool parallel )
+{
+	uint32 table, index;
+
+	if ( !input_get_mouse_bind( handle, &table, &index ) ) return;
+
+	// Enter and leave binds accept the flag but ignore it, they keep hover state of their own.
+	input_set_bind_flag( table, index, BIND_FLAG_PARALLEL, parallel );
+}
+
+uint64 input_flush_throttled( void )
+{
+	BindTable* t = &bind_tables[TABLE_MOVE];
+	BindThrottle* throttle;
+	BindRecord* bind;
+	uint64 now, next = INPUT_WAIT_FOREVER;
+	uint32 i, count;
+
+	if ( !input_initialized || t->throttles == NULL ) return next;
+
+	now = input_platform_get_time();
+
+	input_begin_dispatch();
+
+	// Binds added by the handlers don't have anything pending yet.
+	count = t->count;
+
+	for ( i = 0; i < count; i++ )
 	{
-		bind = (KeyBind*)node;
-		if ( key == bind->key )
+		throttle = &t->throttles[i];
+
+		if ( !throttle->pending ) continue;
+
+		// Not yet, but make sure the caller comes back in time.
+		if ( !input_throttle_due( throttle, now ) )
 		{
-			if ( !bind->handler( key, bind->userdata ) ) ret = false;
+			if ( throttle->last_call + throttle->interval - now < next ) next = throttle->last_call + throttle->interval - now;
+			continue;
 		}
+
+		// The trailing call delivers the newest position the bind was hit at.
+		throttle->last_call = now;
+		throttle->pending = false;
+
+		bind = BIND_RECORD( TABLE_MOVE, i );
+
+		INPUT_TRACE_BEGIN( "mouse bind", MOUSE_NONE );
+		bind->mouse_handler( MOUSE_NONE, throttle->x, throttle->y, bind->userdata );
+		INPUT_TRACE_END();
 	}
 
-	return ret;
+	input_end_dispatch();
+
+	return next;
+}
+
+bool input_capture_mouse( MouseBind* move_bind, MouseBind* release_bind )
+{
+	uint32 table, index;
+
+	if ( !input_initialized ) return false;
+	if ( move_bind == NULL && release_bind == NULL ) return false;
+
+	if ( move_bind != NULL && ( !input_get_mouse_bind( move_bind, &table, &index ) || table != TABLE_MOVE ) ) return false;
+	if ( release_bind != NULL && ( !input_get_mouse_bind( release_bind, &table, &index ) || table != TABLE_BTNUP ) ) return false;
+
+	// Captured from a down bind the capture lasts until that button is released, otherwise until any button is.
+	capture_move = move_bind;
+	capture_release = release_bind;
+	capture_button = pressed_button;
+
+	if ( !mouse_captured )
+	{
+		mouse_captured = true;
+		input_platform_capture_pointer( true );
+	}
+
+	return true;
+}
+
+void input_release_mouse( void )
+{
+	if ( !mouse_captured ) return;
+
+	mouse_captured = false;
+	capture_move = NULL;
+	capture_release = NULL;
+
+	input_platform_capture_pointer( false );
+}
+
+bool input_is_mouse_captured( void )
+{
+	return mouse_captured;
 }
 
 bool input_handle_mouse_move_bind( int16 x, int16 y )
 {
-	MouseBind* bind;
-	node_t *node, *tmp;
-	bool ret = true;
+	bool ret = true, called;
 
 	if ( !input_initialized ) return true;
 
-	list_foreach_safe( mouse_move_binds, node, tmp )
+	input_begin_dispatch();
+
+	// While the pointer is captured all motion goes to the capturing bind, wherever the cursor is.
+	// Nothing else is hit tested, so other binds don't see enter or leave either.
+	if ( capture_move != NULL )
 	{
-		bind = (MouseBind*)node;
+		ret = input_call_mouse_bind( capture_move, MOUSE_NONE, x, y, &called );
 
-		if ( rect_is_point_in( &bind->bounds, x, y ) )
+		if ( called )
 		{
-			if ( !bind->handler( MOUSE_NONE, x, y, bind->userdata ) )
-			{
-				ret = false;
-			}
+			input_end_dispatch();
+			return ret;
 		}
+
+		// The bind has been removed, the capture goes with it.
+		input_release_mouse();
 	}
 
+	if ( !input_handle_mouse_binds( TABLE_MOVE, MOUSE_NONE, x, y ) ) ret = false;
+
+	// Enter/leave binds are only called when the cursor crosses their boundaries.
+	if ( !input_handle_hover_binds( TABLE_ENTER, x, y ) ) ret = false;
+	if ( !input_handle_hover_binds( TABLE_LEAVE, x, y ) ) ret = false;
+
+	input_end_dispatch();
+
 	return ret;
 }
 
 bool input_handle_mouse_up_bind( MOUSEBTN button, int16 x, int16 y )
 {
-	MouseBind* bind;
-	node_t *node, *tmp;
-	bool ret = true;
+	MouseBind* release;
+	bool ret = true, called = false;
 
 	if ( !input_initialized ) return true;
 
-	list_foreach_safe( mouse_up_binds, node, tmp )
+	input_begin_dispatch();
+
+	if ( mouse_captured && ( capture_button == MOUSE_NONE || capture_button == button ) )
 	{
-		bind = (MouseBind*)node;
+		// The capture ends before the handler is called, so the handler is free to capture again.
+		release = capture_release;
+		input_release_mouse();
 
-		if ( bind->button == button && rect_is_point_in( &bind->bounds, x, y ) )
-		{
-			if ( !bind->handler( button, x, y, bind->userdata ) )
-			{
-				ret = false;
-			}
-		}
+		if ( release != NULL ) ret = input_call_mouse_bind( release, button, x, y, &called );
 	}
 
+	if ( !called ) ret = input_handle_mouse_binds( TABLE_BTNUP, button, x, y );
+
+	input_end_dispatch();
+
 	return ret;
 }
 
 bool input_handle_mouse_down_bind( MOUSEBTN button, int16 x, int16 y )
 {
-	MouseBind* bind;
-	node_t *node, *tmp;
-	bool ret = true;
+	bool ret;
 
 	if ( !input_initialized ) return true;
 
-	list_foreach_safe( mouse_down_binds, node, tmp )
+	input_begin_dispatch();
+
+	pressed_button = button;
+	ret = input_handle_mouse_binds( TABLE_BTNDOWN, button, x, y );
+	pressed_button = MOUSE_NONE;
+
+	input_end_dispatch();
+
+	return ret;
+}
+
+static bool input_count_dispatch( INPUT_EVENT type, bool ret )
+{
+	InputEventStats* stats = &event_stats[type];
+
+	input_stat_add( stats->dispatched, 1 );
+
+	if ( ret ) return true;
+
+	if ( keys_blocked )
+	{
+		keys_blocked = false;
+		input_stat_add( stats->blocked, 1 );
+	}
+	else
+	{
+		input_stat_add( stats->consumed, 1 );
+	}
+
+	return false;
+}
+
+static bool input_dispatch_event( const QueuedEvent* event )
+{
+	bool ret = true;
+
+	// Time the event spent waiting in the queue (next to nothing unless queued dispatch is enabled).
+	INPUT_TRACE_SPAN( "queued", event->type, event->time, input_platform_get_time() );
+	INPUT_TRACE_BEGIN( "dispatch", event->type );
+
+	input_set_event_state( event->modifiers, event->buttons );
+	dispatch_time = event->time;
+
+	switch ( event->type )
+	{
+	case INPUT_CHARACTER:
+		ret = input_handle_keyboard_event( INPUT_CHARACTER, event->key );
+		if ( ret ) ret = input_handle_char_bind( event->key );
+		ret = input_count_dispatch( INPUT_CHARACTER, ret );
+		break;
+
+	case INPUT_KEY_DOWN:
+		ret = input_handle_keyboard_event( INPUT_KEY_DOWN, event->key );
+		if ( ret ) ret = input_handle_key_down_bind( event->key );
+		if ( ret ) ret = input_handle_keymap( INPUT_KEY_DOWN, event->state_key );
+		ret = input_count_dispatch( INPUT_KEY_DOWN, ret );
+
+		// The character is only processed if the key press wasn't consumed.
+		if ( !ret || event->character == 0 ) break;
+
+		ret = input_handle_keyboard_event( INPUT_CHARACTER, event->character );
+		if ( ret ) ret = input_handle_char_bind( event->character );
+		ret = input_count_dispatch( INPUT_CHARACTER, ret );
+		break;
+
+	case INPUT_KEY_UP:
+		ret = input_handle_keyboard_event( INPUT_KEY_UP, event->key );
+		if ( ret ) ret = input_handle_key_up_bind( event->key );
+		if ( ret ) ret = input_handle_keymap( INPUT_KEY_UP, event->state_key );
+		ret = input_count_dispatch( INPUT_KEY_UP, ret );
+		break;
+
+	case INPUT_MOUSE_MOVE:
+		if ( event->flags & QUEUED_RELATIVE )
+		{
+			ret = input_handle_relative_mouse_event( event->x, event->y );
+			ret = input_count_dispatch( INPUT_MOUSE_MOVE, ret );
+			break;
+		}
+
+		ret = input_handle_mouse_event( INPUT_MOUSE_MOVE, event->x, event->y, MOUSE_NONE, MWHEEL_STATIONARY );
+		if ( ret ) ret = input_handle_mouse_move_bind( event->x, event->y );
+		ret = input_count_dispatch( INPUT_MOUSE_MOVE, ret );
+		break;
+
+	case INPUT_MOUSE_WHEEL:
+		ret = input_handle_mouse_event( INPUT_MOUSE_WHEEL, event->x, event->y, MOUSE_NONE, (MOUSEWHEEL)event->wheel );
+		ret = input_count_dispatch( INPUT_MOUSE_WHEEL, ret );
+		break;
+
+	case INPUT_LBUTTON_DOWN:
+	case INPUT_MBUTTON_DOWN:
+	case INPUT_RBUTTON_DOWN:
+		ret = input_handle_mouse_event( (INPUT_EVENT)event->type, event->x, event->y, (MOUSEBTN)event->button, MWHEEL_STATIONARY );
+		if ( ret ) ret = input_handle_mouse_down_bind( (MOUSEBTN)event->button, event->x, event->y );
+		ret = input_count_dispatch( (INPUT_EVENT)event->type, ret );
+		break;
+
+	case INPUT_LBUTTON_UP:
+	case INPUT_MBUTTON_UP:
+	case INPUT_RBUTTON_UP:
+		ret = input_handle_mouse_event( (INPUT_EVENT)event->type, event->x, event->y, (MOUSEBTN)event->button, MWHEEL_STATIONARY );
+		if ( ret ) ret = input_handle_mouse_up_bind( (MOUSEBTN)event->button, event->x, event->y );
+		ret = input_count_dispatch( (INPUT_EVENT)event->type, ret );
+		break;
+	}
+
+	// The state and the ticks get the event whether or not it was consumed, it's what the user is doing either way.
+	input_publish_event( (INPUT_EVENT)event->type, event->state_key, event->time );
+	input_resample_event( event );
+
+	INPUT_TRACE_END();
+
+	return ret;
+}
+
+static bool input_is_release( INPUT_EVENT type )
+{
+	return type == INPUT_KEY_UP || type == INPUT_LBUTTON_UP || type == INPUT_MBUTTON_UP || type == INPUT_RBUTTON_UP;
+}
+
+static void input_grow_queue( void )
+{
+	QueuedEvent* events;
+	uint32 capacity, i;
+
+	// Grow the ring buffer and unwrap the events while at it.
+	capacity = queue_capacity ? queue_capacity * 2 : 256;
+	events = mem_alloc( capacity * sizeof(*events) );
+
+	for ( i = 0; i < queue_count; i++ )
+		events[i] = event_queue[( queue_head + i ) & ( queue_capacity - 1 )];
+
+	mem_free( event_queue );
+
+	event_queue = events;
+	queue_capacity = capacity;
+
+	input_track_memory();
+	queue_head = 0;
+}
+
+static bool input_evict_motion( void )
+{
+	QueuedEvent *event, *first[2] = { NULL, NULL };
+	uint32 i, victim = queue_count, mask = queue_capacity - 1;
+	uint32 kind;
+
+	// Motion is the only thing that can go without losing state. Prefer merging the oldest motion into
+	// a later one of the same kind, which keeps the final position and every relative delta.
+	for ( i = 0; i < queue_count; i++ )
+	{
+		event = &event_queue[( queue_head + i ) & mask];
+		if ( event->type != INPUT_MOUSE_MOVE ) continue;
+
+		if ( victim == queue_count ) victim = i;
+
+		kind = ( event->flags & QUEUED_RELATIVE ) ? 1 : 0;
+
+		if ( first[kind] == NULL )
+		{
+			first[kind] = event;
+			continue;
+		}
+
+		if ( kind )
+		{
+			event->x += first[kind]->x;
+			event->y += first[kind]->y;
+		}
+
+		victim = (uint32)( ( first[kind] - event_queue - queue_head ) & mask );
+		input_stat_add( event_stats[INPUT_MOUSE_MOVE].coalesced, 1 );
+		break;
+	}
+
+	if ( victim == queue_count ) return false;
+
+	// Nothing to merge with, the oldest motion is simply lost.
+	if ( i == queue_count )
+		input_stat_add( event_stats[INPUT_MOUSE_MOVE].dropped, 1 );
+
+	// Close the gap by moving the events before the victim forward by one.
+	for ( i = victim; i > 0; i-- )
+		event_queue[( queue_head + i ) & mask] = event_queue[( queue_head + i - 1 ) & mask];
+
+	queue_head = ( queue_head + 1 ) & mask;
+	queue_count--;
+
+	return true;
+}
+
+static bool input_queue_event( const QueuedEvent* event )
+{
+	QueuedEvent* tail;
+
+	if ( queue_count == queue_capacity && queue_capacity < INPUT_QUEUE_MAX )
+		input_grow_queue();
+
+	if ( queue_count == queue_capacity )
 	{
-		bind = (MouseBind*)node;
+		// The queue is full. Motion can still be merged into the last event if it's motion as well.
+		tail = &event_queue[( queue_head + queue_count - 1 ) & ( queue_capacity - 1 )];
 
-		if ( bind->button == button && rect_is_point_in( &bind->bounds, x, y ) )
+		if ( event->type == INPUT_MOUSE_MOVE && tail->type == INPUT_MOUSE_MOVE && event->flags == tail->flags )
 		{
-			if ( !bind->handler( button, x, y, bind->userdata ) )
+			if ( event->flags & QUEUED_RELATIVE )
 			{
-				ret = false;
+				tail->x += event->x;
+				tail->y += event->y;
+			}
+			else
+			{
+				tail->x = event->x;
+				tail->y = event->y;
+			}
+
+			tail->time = event->time;
+			tail->modifiers = event->modifiers;
+			tail->buttons = event->buttons;
+
+			input_stat_add( event_stats[INPUT_MOUSE_MOVE].coalesced, 1 );
+
+			return true;
+		}
+
+		// Otherwise make room by giving up older motion. A release must never be lost or the key or button
+		// would stay down for good, so releases get past the size limit if there's no motion to give up.
+		if ( !input_evict_motion() )
+		{
+			if ( input_is_release( (INPUT_EVENT)event->type ) )
+			{
+				input_grow_queue();
+			}
+			else
+			{
+				input_stat_add( event_stats[event->type].dropped, 1 );
+				if ( event->character ) input_stat_add( event_stats[INPUT_CHARACTER].dropped, 1 );
+
+				return false;
 			}
 		}
 	}
 
-	return ret;
+	event_queue[( queue_head + queue_count ) & ( queue_capacity - 1 )] = *event;
+	queue_count++;
+
+	return true;
+}
+
+static bool input_post_event( QueuedEvent* event )
+{
+	if ( !input_initialized ) return true;
+
+	event->time = event_time ? event_time : input_platform_get_time();
+	event->modifiers = input_modifiers;
+	event->buttons = input_buttons;
+
+	input_stat_add( event_stats[event->type].received, 1 );
+	if ( event->character ) input_stat_add( event_stats[INPUT_CHARACTER].received, 1 );
+
+	if ( !queued_dispatch )
+		return input_dispatch_event( event );
+
+	// The event will be dispatched later, let the application process it as it sees fit.
+	input_queue_event( event );
+
+	return true;
+}
+
+void input_set_event_time( uint64 time )
+{
+	event_time = time;
+}
+
+bool input_post_keyboard_event( INPUT_EVENT type, uint32 key, uint32 character )
+{
+	return input_post_key_event( type, key, key, character );
+}
+
+bool input_post_key_event( INPUT_EVENT type, uint32 key, uint32 state_key, uint32 character )
+{
+	QueuedEvent event;
+
+	memset( &event, 0, sizeof(event) );
+
+	event.type = (uint8)type;
+	event.key = key;
+	event.state_key = state_key;
+	event.character = character;
+
+	return input_post_event( &event );
+}
+
+bool input_post_mouse_event( INPUT_EVENT type, int16 x, int16 y, MOUSEBTN button, MOUSEWHEEL wheel )
+{
+	QueuedEvent event;
+
+	memset( &event, 0, sizeof(event) );
+
+	event.type = (uint8)type;
+	event.x = x;
+	event.y = y;
+	event.button = (uint8)button;
+	event.wheel = (uint8)wheel;
+
+	return input_post_event( &event );
+}
+
+bool input_post_relative_mouse_event( int16 dx, int16 dy )
+{
+	QueuedEvent event;
+
+	memset( &event, 0, sizeof(event) );
+
+	event.type = INPUT_MOUSE_MOVE;
+	event.flags = QUEUED_RELATIVE;
+	event.x = dx;
+	event.y = dy;
+
+	return input_post_event( &event );
+}
+
+void input_set_queued_dispatch( bool enable )
+{
+	if ( !input_initialized ) return;
+
+	// Don't leave anything behind in the queue when going back to direct dispatch.
+	if ( !enable ) input_dispatch( 0 );
+
+	queued_dispatch = enable;
+}
+
+bool input_is_dispatch_queued( void )
+{
+	return queued_dispatch;
+}
+
+uint32 input_dispatch( uint64 budget_ns )
+{
+	QueuedEvent event;
+	uint64 start;
+
+	if ( !input_initialized || dispatching_queue ) return queue_count;
+
+	dispatching_queue = true;
+	start = budget_ns ? input_platform_get_time() : 0;
+
+	// Events are dispatched in the order they were received. At least one event is always dispatched so that
+	// the queue keeps moving even if a single event takes longer than the budget.
+	while ( queue_count != 0 )
+	{
+		event = event_queue[queue_head];
+
+		queue_head = ( queue_head + 1 ) & ( queue_capacity - 1 );
+		queue_count--;
+
+		input_dispatch_event( &event );
+
+		if ( budget_ns && input_platform_get_time() - start >= budget_ns )
+			break;
+	}
+
+	dispatching_queue = false;
+
+	input_flush_throttled();
+
+	return queue_count;
+}
+
+uint32 input_get_queue_depth( void )
+{
+	return queue_count;
+}
+
+void input_get_stats( InputStats* stats )
+{
+	uint32 i;
+	InputEventStats* counters;
+
+	memset( stats, 0, sizeof(*stats) );
+
+	for ( i = 0; i < NUM_INPUT_EVENTS; i++ )
+	{
+		counters = &event_stats[i];
+
+		stats->events[i].received = input_stat_get( counters->received );
+		stats->events[i].dispatched = input_stat_get( counters->dispatched );
+		stats->events[i].consumed = input_stat_get( counters->consumed );
+		stats->events[i].blocked = input_stat_get( counters->blocked );
+		stats->events[i].coalesced = input_stat_get( counters->coalesced );
+		stats->events[i].dropped = input_stat_get( counters->dropped );
+	}
+
+	if ( !input_initialized ) return;
+
+	for ( i = 0; i < NUM_INPUT_EVENTS; i++ )
+		stats->hooks[i] = input_hooks[i].count - input_hooks[i].removed;
+
+	for ( i = 0; i < NUM_KEYBIND_TYPES; i++ )
+	{
+		stats->key_binds[i] = bind_tables[input_get_key_table( (BINDTYPE_KB)i )].count -
+							  bind_tables[input_get_key_table( (BINDTYPE_KB)i )].removed;
+	}
+
+	for ( i = 0; i < NUM_MOUSEBIND_TYPES; i++ )
+	{
+		stats->mouse_binds[i] = bind_tables[input_get_mouse_table( (BINDTYPE_MOUSE)i )].count -
+								bind_tables[input_get_mouse_table( (BINDTYPE_MOUSE)i )].removed;
+	}
+
+	stats->queue_depth = queue_count;
+	stats->bind_slots = num_slots;
+	stats->memory_used = input_get_memory_used();
+	stats->memory_peak = memory_peak;
+
+	// A bind is a handler record, a handle slot, a tag and a slot in the handle table, plus an area for mouse binds.
+	stats->key_bind_size = sizeof(BindRecord) + sizeof(uint32) + sizeof(uint16) + sizeof(BindSlot);
+	stats->mouse_bind_size = stats->key_bind_size + 4 * sizeof(int16);
 }
@@ -59,6 +59,56 @@ typedef enum {
 	MWHEEL_DOWN,
 } MOUSEWHEEL;
 
+/**
+ * Modifier keys.
+ * Reported by input events and input_get_modifiers as a mask of held down modifiers.
+ */
+typedef enum {
+	MODIFIER_LSHIFT		= 0x01,
+	MODIFIER_RSHIFT		= 0x02,
+	MODIFIER_LCONTROL	= 0x04,
+	MODIFIER_RCONTROL	= 0x08,
+	MODIFIER_LALT		= 0x10,
+	MODIFIER_RALT		= 0x20,
+	MODIFIER_SHIFT		= MODIFIER_LSHIFT|MODIFIER_RSHIFT,
+	MODIFIER_CONTROL	= MODIFIER_LCONTROL|MODIFIER_RCONTROL,
+	MODIFIER_ALT		= MODIFIER_LALT|MODIFIER_RALT,
+} MODIFIER;
+
+/**
+ * Mouse button mask.
+ * Reported by input events and input_get_mouse_buttons as a mask of held down buttons.
+ */
+typedef enum {
+	MOUSEMASK_LBUTTON	= 1 << MOUSE_LBUTTON,
+	MOUSEMASK_MBUTTON	= 1 << MOUSE_MBUTTON,
+	MOUSEMASK_RBUTTON	= 1 << MOUSE_RBUTTON,
+} MOUSEMASK;
+
+/**
+ * Keyboard bind types.
+ * Used to describe binds for input_add_key_binds.
+ */
+typedef enum {
+	BIND_KEYUP,
+	BIND_KEYDOWN,
+	BIND_CHAR,
+	NUM_KEYBIND_TYPES
+} BINDTYPE_KB;
+
+/**
+ * Mouse bind types.
+ * Used to describe binds for input_add_mouse_binds.
+ */
+typedef enum {
+	BIND_BTNUP,
+	BIND_BTNDOWN,
+	BIND_MOVE,
+	BIND_ENTER,
+	BIND_LEAVE,
+	NUM_MOUSEBIND_TYPES
+} BINDTYPE_MOUSE;
+
 /**
  * Input hook callback arguments.
  *
@@ -70,11 +120,15 @@ typedef struct {
 	/* Type of the event is always returned first. */
 	INPUT_EVENT type;
 
+	/* State of the modifier keys and mouse buttons, as it was right after the event (see MODIFIER and MOUSEMASK). */
+	uint8 modifiers;
+	uint8 buttons;
+
 	union {
 		/* Mouse info, returned when a mouse event is triggered. */
 		struct {
 			int16 x, y;		/* Current mouse cursor position. */
-			int16 dx, dy;	/* Cursor position change since the last callback. */
+			int16 dx, dy;	/* Cursor position change since the last callback. Only these change while the pointer is locked. */
 			uint8 button;	/* Pressed button (see MOUSEBTN above). */
 			uint8 wheel;	/* Mouse wheel movement (see MOUSEWHEEL above). */
 		} mouse;
@@ -87,48 +141,264 @@ typedef struct {
 } InputEvent;
 
 /**
- * Typedefs for key/mouse bind data and bind/hook functions.
+ * Flags for input_initialize_ex.
+ */
+typedef enum {
+	INPUT_INIT_THREAD	= 0x01,	/* Read input events on a background thread as soon as they arrive (X11 only).
+								   The events are timestamped on arrival and dispatched by input_process( NULL ). */
+} INPUT_INIT;
+
+/**
+ * Results of input_wait, combined as flags. Zero means that the wait timed out.
+ */
+typedef enum {
+	INPUT_WAIT_INPUT	= 0x01,	/* Input events arrived and have been processed. */
+	INPUT_WAIT_EVENTS	= 0x02,	/* Other window system events are waiting for the application. */
+	INPUT_WAIT_HANDLES	= 0x04,	/* At least one of the handles passed to input_wait is ready. */
+	INPUT_WAIT_ERROR	= 0x08,	/* Waiting failed. */
+} INPUT_WAIT;
+
+#define INPUT_WAIT_FOREVER		0xFFFFFFFFFFFFFFFFULL
+#define INPUT_WAIT_MAX_HANDLES	32
+#define INPUT_MAX_FOCUS_CHAIN	16
+#define INPUT_MAX_WORKERS		16
+
+/**
+ * Application handles input_wait can wait on along with input:
+ * file descriptors on X11 and waitable object handles (HANDLE) on Windows.
+ */
+#ifdef _WIN32
+typedef void*			input_wait_t;
+#else
+typedef int				input_wait_t;
+#endif
+
+/**
+ * Input statistics.
+ *
+ * Reported by input_get_stats. The event counters keep growing for as long as the library is initialized,
+ * so event rates can be calculated by sampling them periodically.
+ */
+typedef struct {
+	uint64 received;	/* Events received from the windowing system. */
+	uint64 dispatched;	/* Events passed on to hooks and binds. */
+	uint64 consumed;	/* Events consumed by a hook or a bind (the handler returned false). */
+	uint64 blocked;		/* Events blocked by input_block_keys. */
+	uint64 coalesced;	/* Events merged into the previous event because the queue was full. */
+	uint64 dropped;		/* Events dropped because the queue was full. */
+} InputEventStats;
+
+typedef struct {
+	InputEventStats	events[NUM_INPUT_EVENTS];			/* Event counters for each input event type. */
+	uint32			hooks[NUM_INPUT_EVENTS];			/* Number of hooks for each input event type. */
+	uint32			key_binds[NUM_KEYBIND_TYPES];		/* Number of key binds of each type (see BINDTYPE_KB). */
+	uint32			mouse_binds[NUM_MOUSEBIND_TYPES];	/* Number of mouse binds of each type (see BINDTYPE_MOUSE). */
+	uint32			queue_depth;						/* Number of events waiting for input_dispatch. */
+	uint32			bind_slots;							/* Number of bind handle slots, in use or free. Tracks the most binds alive at once. */
+	uint64			memory_used;						/* Bytes currently allocated for binds, hooks and the event queue. */
+	uint64			memory_peak;						/* Most bytes allocated at once since the library was initialized. */
+	uint32			key_bind_size;						/* Bytes used by a single key bind, not counting spare capacity. */
+	uint32			mouse_bind_size;					/* Bytes used by a single mouse bind, not counting spare capacity. */
+} InputStats;
+
+/**
+ * Shared input state.
+ *
+ * A snapshot of the input state as published by input_publish_state and read by input_read_shared_state.
+ * Keys are tracked in a bitmap of INPUT_SHARED_KEYS bits: key codes below 0x100 map to themselves and X11
+ * function keysyms (0xFF00-0xFFFF) to the upper half. Other keys are not tracked. On X11 a key is tracked by
+ * its unshifted keysym with letters in upper case, so shift+1 shows up as '1' and a as 'A'.
+ */
+#define INPUT_SHARED_KEYS			512
+#define INPUT_SHARED_KEY(key)		( (key) < 0x100 ? (key) : ( (key) & 0xFFFFFF00 ) == 0xFF00 ? 0x100 | ( (key) & 0xFF ) : INPUT_SHARED_KEYS )
+#define INPUT_SHARED_KEY_DOWN(state, key) \
+	( INPUT_SHARED_KEY(key) < INPUT_SHARED_KEYS && ( (state)->keys[INPUT_SHARED_KEY(key) >> 5] & ( 1u << ( INPUT_SHARED_KEY(key) & 31 ) ) ) != 0 )
+
+typedef struct {
+	uint64			time;								/* Timestamp of the last event in nanoseconds (monotonic clock). */
+	uint32			events;								/* Number of events published so far. */
+	uint32			modifiers;							/* Modifier keys held down (see MODIFIER). */
+	uint32			buttons;							/* Mouse buttons held down (see MOUSEMASK). */
+	int16			mouse_x;							/* Cursor position. */
+	int16			mouse_y;
+	uint32			keys[INPUT_SHARED_KEYS / 32];		/* Keys held down, see INPUT_SHARED_KEY_DOWN. */
+} InputSharedState;
+
+typedef struct InputSharedRegion InputSharedRegion;
+
+/**
+ * Fixed-timestep input.
+ *
+ * Returned by input_read_tick. Each tick covers tick_ns nanoseconds of input by event timestamp: the key and
+ * button transitions that happened during it in the order they happened, and the mouse motion and wheel
+ * clicks accumulated over it. A tick holds at most INPUT_TICK_MAX_TRANSITIONS transitions, any more are
+ * moved to the next tick along with everything after them so that the order is never broken.
+ */
+#define INPUT_TICK_MAX_TRANSITIONS	32
+
+typedef struct {
+	uint64			time;								/* Timestamp of the transition. */
+	uint32			key;								/* Unshifted key for key events (see INPUT_SHARED_KEYS), button (MOUSEBTN) for button events. */
+	uint8			type;								/* INPUT_KEY_DOWN, INPUT_KEY_UP or one of the mouse button events. */
+	uint8			modifiers;							/* Modifier keys held down when the transition happened (see MODIFIER). */
+	uint8			buttons;							/* Mouse buttons held down when the transition happened (see MOUSEMASK). */
+} InputTransition;
+
+typedef struct {
+	uint64			index;								/* Number of the tick, counted from input_start_ticks. */
+	uint64			start;								/* Time the tick starts at. */
+	uint64			end;								/* Time the tick ends at, the start of the next tick. */
+	int32			dx, dy;								/* Mouse motion during the tick, absolute and relative motion combined. */
+	int32			wheel;								/* Wheel clicks during the tick, positive when scrolling up. */
+	int16			mouse_x, mouse_y;					/* Cursor position at the end of the tick. */
+	uint32			dropped;							/* Events lost before the tick because ticks weren't read fast enough. */
+	uint32			num_transitions;					/* Number of transitions in the tick. */
+	InputTransition	transitions[INPUT_TICK_MAX_TRANSITIONS];
+} InputTick;
+
+/**
+ * Typedefs for key/mouse bind handles and bind/hook functions.
+ *
+ * Bind handles are opaque. Once a bind has been removed its handle becomes stale,
+ * and passing it to the library again is detected and ignored.
  */
 typedef struct KeyBind		KeyBind;
 typedef struct MouseBind	MouseBind;
 
 typedef bool			( *input_handler_t )			( InputEvent* event );
+typedef bool			( *input_data_handler_t )		( InputEvent* event, void* data );
 typedef bool			( *keybind_func_t )				( uint32 key, void* data );
 typedef bool			( *mousebind_func_t )			( MOUSEBTN button, uint16 x, uint16 y, void* data );
+typedef bool			( *keymap_func_t )				( uint32 action, void* data );
+
+/**
+ * Bind descriptors.
+ *
+ * Used to register a large number of binds at once via input_add_key_binds and input_add_mouse_binds.
+ * The fields match the arguments of the corresponding input_add_*_bind functions.
+ */
+typedef struct {
+	BINDTYPE_KB			type;
+	uint32				key;
+	keybind_func_t		func;
+	void*				data;
+} KeyBindDesc;
+
+typedef struct {
+	BINDTYPE_MOUSE		type;
+	MOUSEBTN			button;	/* Ignored by move/enter/leave binds. */
+	rectangle_t			bounds;
+	mousebind_func_t	func;
+	void*				data;
+} MouseBindDesc;
 
 __BEGIN_DECLS
 
 MYLLY_API void			input_initialize				( void* window );
+MYLLY_API void			input_initialize_ex				( void* window, uint32 flags );
 MYLLY_API void			input_shutdown					( void );
 MYLLY_API bool			input_process					( void* data );
+MYLLY_API uint32		input_wait						( uint64 timeout_ns, const input_wait_t* handles, uint32 count );
 
 MYLLY_API void			input_enable_hook				( bool enable );
 
+MYLLY_API void			input_set_queued_dispatch		( bool enable );
+MYLLY_API uint32		input_dispatch					( uint64 budget_ns );
+MYLLY_API uint32		input_get_queue_depth			( void );
+
 MYLLY_API void			input_add_hook					( INPUT_EVENT event, input_handler_t handler );
 MYLLY_API void			input_remove_hook				( INPUT_EVENT event, input_handler_t handler );
+MYLLY_API void			input_add_data_hook				( INPUT_EVENT event, input_data_handler_t handler, void* data );
+MYLLY_API void			input_remove_data_hook			( INPUT_EVENT event, input_data_handler_t handler, void* data );
 
 MYLLY_API KeyBind*		input_add_char_bind				( uint32 key, keybind_func_t func, void* data );
 MYLLY_API KeyBind*		input_add_key_up_bind			( uint32 key, keybind_func_t func, void* data );
 MYLLY_API KeyBind*		input_add_key_down_bind			( uint32 key, keybind_func_t func, void* data );
 MYLLY_API MouseBind*	input_add_mouse_move_bind		( rectangle_t* r, mousebind_func_t func, void* data );
+MYLLY_API MouseBind*	input_add_mouse_enter_bind		( rectangle_t* r, mousebind_func_t func, void* data );
+MYLLY_API MouseBind*	input_add_mouse_leave_bind		( rectangle_t* r, mousebind_func_t func, void* data );
 MYLLY_API MouseBind*	input_add_mousebtn_up_bind		( MOUSEBTN button, rectangle_t* r, mousebind_func_t func, void* data );
 MYLLY_API MouseBind*	input_add_mousebtn_down_bind	( MOUSEBTN button, rectangle_t* r, mousebind_func_t func, void* data );
 
+MYLLY_API bool			input_add_key_binds				( const KeyBindDesc* binds, uint32 count, KeyBind** handles );
+MYLLY_API bool			input_add_mouse_binds			( const MouseBindDesc* binds, uint32 count, MouseBind** handles );
+
 MYLLY_API void			input_remove_char_bind			( uint32 key, keybind_func_t func );
 MYLLY_API void			input_remove_key_up_bind		( uint32 key, keybind_func_t func );
 MYLLY_API void			input_remove_key_down_bind		( uint32 key, keybind_func_t func );
 MYLLY_API void			input_remove_mouse_move_bind	( mousebind_func_t func );
+MYLLY_API void			input_remove_mouse_enter_bind	( mousebind_func_t func );
+MYLLY_API void			input_remove_mouse_leave_bind	( mousebind_func_t func );
 MYLLY_API void			input_remove_mousebtn_up_bind	( MOUSEBTN button, mousebind_func_t func );
 MYLLY_API void			input_remove_mousebtn_down_bind	( MOUSEBTN button, mousebind_func_t func );
 MYLLY_API void			input_remove_key_bind			( KeyBind* bind );
 MYLLY_API void			input_remove_mouse_bind			( MouseBind* bind );
+MYLLY_API void			input_remove_key_binds			( KeyBind** binds, uint32 count );
+MYLLY_API void			input_remove_mouse_binds		( MouseBind** binds, uint32 count );
+
+/**
+ * Pointer capture.
+ *
+ * Usually called by a button down bind to route the rest of a drag to a single widget: all motion goes
+ * to the move bind and the release of the button to the button up bind, without hit testing and wherever
+ * the cursor is. Other move, enter, leave and up binds don't see the captured events. Either bind may be
+ * NULL to leave that part of the input alone. The capture ends when the button that was being pressed is
+ * released (any button if the pointer wasn't captured from a down bind) or when input_release_mouse is called.
+ */
+MYLLY_API bool			input_capture_mouse				( MouseBind* move_bind, MouseBind* release_bind );
+MYLLY_API void			input_release_mouse				( void );
+MYLLY_API bool			input_is_mouse_captured			( void );
+
+/**
+ * Keyboard focus.
+ *
+ * A focusable key bind is only called while it's in the focus chain, typically the binds of a text field
+ * with focus followed by those of its parents. Key and character events go through the chain first,
+ * innermost bind first, and then to the global (not focusable) binds unless a focused bind consumed the event.
+ * Bind handles in the chain are copied, and a removed bind simply drops out of it.
+ */
+MYLLY_API void			input_set_keybind_focusable		( KeyBind* bind, bool focusable );
+MYLLY_API bool			input_set_key_focus				( KeyBind** chain, uint32 count );
 
 MYLLY_API void			input_set_mousebind_button		( MouseBind* bind, MOUSEBTN button );
 MYLLY_API void			input_set_mousebind_rect		( MouseBind* bind, rectangle_t* r );
 MYLLY_API void			input_set_mousebind_func		( MouseBind* bind, mousebind_func_t func );
 MYLLY_API void			input_set_mousebind_param		( MouseBind* bind, void* data );
 
+/**
+ * Precompiled keymaps.
+ *
+ * input_compile_keymap compiles a text keymap into a binary file which input_load_keymap maps into memory and
+ * uses for dispatch as is. Each line of the source binds a chord to an application defined action id:
+ *
+ *     # <action> [down|up] <chord>
+ *     12 ctrl+s
+ *     13 up space
+ *     14 ctrl+shift+f5
+ *
+ * The modifiers are shift, ctrl and alt, the key is a single character, a key name (escape, f1, numpad0...)
+ * or a platform specific key code in hex. Chords match the unshifted key, a shifted symbol is stored as its
+ * key on a US layout plus shift, so ctrl+! is the same chord as ctrl+shift+1. A matching key press or release calls the keymap handler after the
+ * key binds, and the handler returning false consumes the key. A compiled keymap only loads on the platform
+ * it was compiled on. When the keymap is watched it's reloaded by input_process or input_wait once a new file
+ * has been renamed over it (like input_compile_keymap does), the file is checked at most ten times a second.
+ * The file is mapped, so it must never be rewritten in place while loaded.
+ */
+MYLLY_API bool			input_compile_keymap			( const char* source, const char* path, uint32* error_line );
+MYLLY_API bool			input_load_keymap				( const char* path, keymap_func_t func, void* data );
+MYLLY_API void			input_unload_keymap				( void );
+MYLLY_API bool			input_watch_keymap				( bool watch );
+
+MYLLY_API void			input_get_stats					( InputStats* stats );
+
+MYLLY_API bool			input_trace_start				( uint32 capacity );
+MYLLY_API void			input_trace_stop				( void );
+MYLLY_API bool			input_trace_write				( const char* path );
+
 MYLLY_API bool			input_get_key_state				( uint32 key );
+MYLLY_API uint32		input_get_modifiers				( void );
+MYLLY_API uint32		input_get_mouse_buttons			( void );
+MYLLY_API uint64		input_get_time					( void );
 MYLLY_API void			input_block_keys				( bool block );
 
 MYLLY_API void			input_show_mouse_cursor			( bool show );
@@ -136,6 +406,87 @@ MYLLY_API void			input_show_mouse_cursor_ref		( bool show );
 MYLLY_API bool			input_is_cursor_showing			( void );
 MYLLY_API void			input_get_cursor_pos			( int16* x, int16* y );
 MYLLY_API void			input_set_cursor_pos			( int16 x, int16 y );
+MYLLY_API void			input_set_pointer_lock			( bool lock );
+MYLLY_API bool			input_is_pointer_locked			( void );
+
+/**
+ * Hit shapes for mouse binds.
+ *
+ * A bind with a shape is only hit inside the shape. The bounds of the shape replace the area of the bind,
+ * and input_set_mousebind_rect turns the bind back into a rectangle. The ellipse fills the rectangle,
+ * polygons are given as count x,y pairs, and a mask has a byte for each pixel with nonzero bytes being solid.
+ * Polygons and masks are rasterized into a bit mask when they're set, so testing a shape is always a single
+ * lookup. Masks are limited to 16 million pixels.
+ */
+MYLLY_API bool			input_set_mousebind_ellipse		( MouseBind* bind, rectangle_t* r );
+MYLLY_API bool			input_set_mousebind_polygon		( MouseBind* bind, const int16* points, uint32 count );
+MYLLY_API bool			input_set_mousebind_mask		( MouseBind* bind, int16 x, int16 y, uint16 width, uint16 height, const uint8* mask, uint32 pitch );
+
+/**
+ * Rate limiting for move binds.
+ *
+ * A move bind with an interval is called at most once per interval. Motion in between only updates the
+ * position, and once the interval has passed a trailing call delivers the newest position the bind was hit at.
+ * Trailing calls are made by input_dispatch, input_wait (which wakes up for them) and input_flush_throttled,
+ * which returns the time in nanoseconds until the next trailing call is due (INPUT_WAIT_FOREVER if none is).
+ */
+MYLLY_API bool			input_set_mousebind_interval	( MouseBind* bind, uint64 interval_ns );
+MYLLY_API uint64		input_flush_throttled			( void );
+
+/**
+ * Parallel bind handlers.
+ *
+ * A bind marked parallel promises that its handler is thread safe and doesn't care about the order it's
+ * called in. While worker threads are running, the parallel binds hit by an event are run on the workers
+ * while the rest of the binds are called in order on the dispatching thread, and the event is consumed if
+ * any of them returns false. Parallel handlers must not call back into the library. Without workers, or
+ * for enter/leave binds and binds in the focus chain, the flag does nothing.
+ */
+MYLLY_API void			input_set_keybind_parallel		( KeyBind* bind, bool parallel );
+MYLLY_API void			input_set_mousebind_parallel	( MouseBind* bind, bool parallel );
+MYLLY_API bool			input_start_workers				( uint32 count );
+MYLLY_API void			input_stop_workers				( void );
+
+/**
+ * Shared-memory publication of the input state.
+ *
+ * input_publish_state creates a named shared-memory region and keeps it up to date with every dispatched
+ * event, and input_publish_state( NULL ) stops publishing. Other threads and processes open the region with
+ * input_open_shared_state and take consistent snapshots of it with input_read_shared_state, which never
+ * blocks or makes a system call. The name is a POSIX shared-memory name ("/name") on Linux and a file
+ * mapping name on Windows. Reading fails once the publisher has stopped, or if an update never completes
+ * because the publishing process died in the middle of it.
+ */
+MYLLY_API bool			input_publish_state				( const char* name );
+MYLLY_API InputSharedRegion*	input_open_shared_state		( const char* name );
+MYLLY_API bool			input_read_shared_state			( const InputSharedRegion* region, InputSharedState* state );
+MYLLY_API void			input_close_shared_state		( InputSharedRegion* region );
+
+/**
+ * Fixed-timestep resampling.
+ *
+ * input_start_ticks starts recording dispatched events into ticks of tick_ns nanoseconds, the first one
+ * starting at start_time (0 for now). input_read_tick returns the oldest unread tick once it has ended,
+ * and false if it hasn't. Every tick is returned, including empty ones, so a simulation can simply read
+ * ticks until there are none left. Input should be processed before reading, an event dispatched after its
+ * tick has been read ends up in the oldest unread tick.
+ */
+MYLLY_API bool			input_start_ticks				( uint64 tick_ns, uint64 start_time );
+MYLLY_API void			input_stop_ticks				( void );
+MYLLY_API bool			input_read_tick					( InputTick* tick );
+
+/**
+ * Cursor prediction.
+ *
+ * Once enabled, every cursor position the library sees is fed to a filter which smooths out the motion and
+ * tracks its velocity. input_predict_cursor extrapolates where the cursor will be at the given time (see
+ * input_get_time), for drawing cursor-attached visuals where the cursor will be when the frame is shown.
+ * Predictions are limited to 100 ms ahead, and a cursor that has stopped is predicted to stay put.
+ * Returns false, with the current position, until the first motion has been seen. Costs a handful of
+ * arithmetic operations per event and per prediction, and never allocates.
+ */
+MYLLY_API void			input_enable_prediction			( bool enable );
+MYLLY_API bool			input_predict_cursor			( uint64 time, int16* x, int16* y );
 
 __END_DECLS
 
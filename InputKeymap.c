@@ -0,0 +1,764 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		InputKeymap.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		A portable input hooker library.
+ *				Precompiled binary keymaps mapping key chords to actions.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#include "Input.h"
+#include "InputSys.h"
+#include "Platform/Alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// --------------------------------------------------
+
+/*
+ * A compiled keymap is a header followed by an open addressing hash table of chords, in native byte order.
+ * The file is mapped into memory and looked up in place, so loading it doesn't parse or allocate anything.
+ * Key codes are platform specific (virtual keys on Windows, keysyms on X11), which is why a keymap only
+ * loads on the platform it was compiled on.
+ */
+typedef struct {
+	uint32				magic;		// KEYMAP_MAGIC
+	uint16				version;	// KEYMAP_VERSION
+	uint16				platform;	// KEYMAP_PLATFORM of the platform the keymap was compiled on
+	uint32				count;		// Number of chords in the keymap
+	uint32				capacity;	// Number of entries in the hash table (a power of two)
+} KeymapHeader;
+
+// A single chord and the action it triggers
+typedef struct {
+	uint32				key;		// Key code, letters in upper case
+	uint32				action;		// Application defined action id
+	uint8				modifiers;	// KEYMAP_SHIFT, KEYMAP_CONTROL and KEYMAP_ALT
+	uint8				flags;		// KEYMAP_USED and KEYMAP_UP
+	uint16				reserved;
+} KeymapEntry;
+
+// Name of a key in the keymap source
+typedef struct {
+	const char*			name;
+	uint32				key;
+} KeyName;
+
+#define KEYMAP_MAGIC			0x504D4B4D	// "MKMP"
+#define KEYMAP_VERSION			2			// 2: shifted symbols are stored as their unshifted key plus shift
+
+#ifdef _WIN32
+#define KEYMAP_PLATFORM			1
+#else
+#define KEYMAP_PLATFORM			2
+#endif
+
+#define KEYMAP_SHIFT			0x01
+#define KEYMAP_CONTROL			0x02
+#define KEYMAP_ALT				0x04
+
+#define KEYMAP_USED				0x01	// The entry contains a chord
+#define KEYMAP_UP				0x02	// The action is triggered when the key is released
+
+#define KEYMAP_MIN_CAPACITY		16
+#define KEYMAP_MAX_CAPACITY		0x100000
+#define KEYMAP_MAX_LINE			256
+#define KEYMAP_POLL_INTERVAL	100000000ULL	// Nanoseconds between checks for a changed keymap file
+
+#define KEYMAP_ENTRIES(map)		( (const KeymapEntry*)( (map) + 1 ) )
+#define KEYMAP_SIZE(map)		( sizeof(KeymapHeader) + (size_t)(map)->capacity * sizeof(KeymapEntry) )
+
+// The active keymap is replaced with a single atomic exchange, so a lookup sees either the old or the new table.
+#ifdef _WIN32
+#define keymap_exchange(map)	(const KeymapHeader*)InterlockedExchangePointer( (PVOID volatile*)&active_keymap, (PVOID)(map) )
+#define keymap_get()			(const KeymapHeader*)InterlockedCompareExchangePointer( (PVOID volatile*)&active_keymap, NULL, NULL )
+#else
+#define keymap_exchange(map)	__atomic_exchange_n( &active_keymap, (map), __ATOMIC_ACQ_REL )
+#define keymap_get()			__atomic_load_n( &active_keymap, __ATOMIC_ACQUIRE )
+#endif
+
+// --------------------------------------------------
+
+static const KeymapHeader* active_keymap		= NULL;		// Mapped keymap file, or NULL
+static keymap_func_t	keymap_handler			= NULL;		// Called with the action of a matching chord
+static void*			keymap_userdata			= NULL;
+static char*			keymap_path				= NULL;		// Path the keymap was loaded from, for reloading
+
+#ifdef _WIN32
+static HANDLE			keymap_watch			= NULL;		// Change notification of the keymap's directory
+#else
+static int				keymap_watch			= -1;		// inotify instance watching the keymap's directory
+#endif
+static uint64			keymap_polled			= 0;		// Time the watch was last checked at
+
+static const KeyName key_names[] = {
+	{ "cancel",		MKEY_CANCEL },		{ "backspace",	MKEY_BACKSPACE },	{ "tab",		MKEY_TAB },
+	{ "clear",		MKEY_CLEAR },		{ "return",		MKEY_RETURN },		{ "enter",		MKEY_RETURN },
+	{ "pause",		MKEY_PAUSE },		{ "caps",		MKEY_CAPS },		{ "escape",		MKEY_ESCAPE },
+	{ "space",		MKEY_SPACE },		{ "pagedown",	MKEY_PAGEDOWN },	{ "pageup",		MKEY_PAGEUP },
+	{ "end",		MKEY_END },			{ "home",		MKEY_HOME },		{ "left",		MKEY_LEFT },
+	{ "up",			MKEY_UP },			{ "right",		MKEY_RIGHT },		{ "down",		MKEY_DOWN },
+	{ "printscr",	MKEY_PRINTSCR },	{ "insert",		MKEY_INSERT },		{ "delete",		MKEY_DELETE },
+	{ "numpad0",	MKEY_NUMPAD0 },		{ "numpad1",	MKEY_NUMPAD1 },		{ "numpad2",	MKEY_NUMPAD2 },
+	{ "numpad3",	MKEY_NUMPAD3 },		{ "numpad4",	MKEY_NUMPAD4 },		{ "numpad5",	MKEY_NUMPAD5 },
+	{ "numpad6",	MKEY_NUMPAD6 },		{ "numpad7",	MKEY_NUMPAD7 },		{ "numpad8",	MKEY_NUMPAD8 },
+	{ "numpad9",	MKEY_NUMPAD9 },		{ "multiply",	MKEY_MULTIPLY },	{ "add",		MKEY_ADD },
+	{ "separator",	MKEY_SEPARATOR },	{ "subtract",	MKEY_SUBTRACT },	{ "decimal",	MKEY_DECIMAL },
+	{ "divide",		MKEY_DIVIDE },		{ "f1",			MKEY_F1 },			{ "f2",			MKEY_F2 },
+	{ "f3",			MKEY_F3 },			{ "f4",			MKEY_F4 },			{ "f5",			MKEY_F5 },
+	{ "f6",			MKEY_F6 },			{ "f7",			MKEY_F7 },			{ "f8",			MKEY_F8 },
+	{ "f9",			MKEY_F9 },			{ "f10",		MKEY_F10 },			{ "f11",		MKEY_F11 },
+	{ "f12",		MKEY_F12 },			{ "scroll",		MKEY_SCROLL },		{ "lshift",		MKEY_LSHIFT },
+	{ "rshift",		MKEY_RSHIFT },		{ "lcontrol",	MKEY_LCONTROL },	{ "rcontrol",	MKEY_RCONTROL },
+	{ "lalt",		MKEY_LALT },		{ "ralt",		MKEY_RALT },
+};
+
+// --------------------------------------------------
+
+static uint32 input_hash_chord( uint32 key, uint32 modifiers, uint32 flags, uint32 capacity )
+{
+	uint32 hash = key ^ ( modifiers << 24 ) ^ ( ( flags & KEYMAP_UP ) << 28 );
+
+	hash ^= hash >> 16;
+	hash *= 0x45D9F3B;
+	hash ^= hash >> 16;
+
+	return hash & ( capacity - 1 );
+}
+
+static const KeymapEntry* input_find_chord( const KeymapHeader* map, uint32 key, uint32 modifiers, uint32 flags )
+{
+	const KeymapEntry* entry;
+	uint32 i, n, mask;
+
+	mask = map->capacity - 1;
+
+	// The probe is bounded by the size of the table so that even a full (broken) table can't loop forever.
+	for ( i = input_hash_chord( key, modifiers, flags, map->capacity ), n = 0; n < map->capacity; i = ( i + 1 ) & mask, n++ )
+	{
+		entry = &KEYMAP_ENTRIES( map )[i];
+
+		if ( !( entry->flags & KEYMAP_USED ) ) break;
+
+		if ( entry->key == key && entry->modifiers == modifiers && ( entry->flags & KEYMAP_UP ) == flags )
+			return entry;
+	}
+
+	return NULL;
+}
+
+static uint32 input_get_chord_modifiers( void )
+{
+	uint32 held, modifiers = 0;
+
+	// Chords don't care which one of the modifier keys is held down.
+	held = input_get_modifiers();
+
+	if ( held & MODIFIER_SHIFT ) modifiers |= KEYMAP_SHIFT;
+	if ( held & MODIFIER_CONTROL ) modifiers |= KEYMAP_CONTROL;
+	if ( held & MODIFIER_ALT ) modifiers |= KEYMAP_ALT;
+
+	return modifiers;
+}
+
+static bool input_is_keymap_valid( const KeymapHeader* map, size_t size )
+{
+	if ( map->magic != KEYMAP_MAGIC ) return false;
+	if ( map->version != KEYMAP_VERSION ) return false;
+	if ( map->platform != KEYMAP_PLATFORM ) return false;
+
+	if ( map->capacity < KEYMAP_MIN_CAPACITY || map->capacity > KEYMAP_MAX_CAPACITY ) return false;
+	if ( map->capacity & ( map->capacity - 1 ) ) return false;
+	if ( map->count >= map->capacity ) return false;
+
+	return size == KEYMAP_SIZE( map );
+}
+
+#ifdef _WIN32
+
+static const KeymapHeader* input_map_keymap( const char* path )
+{
+	HANDLE file, mapping;
+	LARGE_INTEGER size;
+	void* view = NULL;
+
+	// Deleting the file is shared so that the keymap can be removed or renamed while it's in use.
+	file = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( file == INVALID_HANDLE_VALUE ) return NULL;
+
+	if ( GetFileSizeEx( file, &size ) && size.QuadPart >= sizeof(KeymapHeader) &&
+		 size.QuadPart <= sizeof(KeymapHeader) + KEYMAP_MAX_CAPACITY * sizeof(KeymapEntry) )
+	{
+		mapping = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+
+		if ( mapping != NULL )
+		{
+			view = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+			CloseHandle( mapping );
+		}
+	}
+
+	CloseHandle( file );
+
+	if ( view == NULL ) return NULL;
+
+	if ( !input_is_keymap_valid( (const KeymapHeader*)view, (size_t)size.QuadPart ) )
+	{
+		UnmapViewOfFile( view );
+		return NULL;
+	}
+
+	return (const KeymapHeader*)view;
+}
+
+static void input_unmap_keymap( const KeymapHeader* map )
+{
+	if ( map != NULL ) UnmapViewOfFile( (void*)map );
+}
+
+static bool input_replace_file( const char* from, const char* to )
+{
+	return MoveFileExA( from, to, MOVEFILE_REPLACE_EXISTING ) != 0;
+}
+
+#else
+
+static const KeymapHeader* input_map_keymap( const char* path )
+{
+	struct stat st;
+	void* view;
+	int fd;
+
+	fd = open( path, O_RDONLY|O_CLOEXEC );
+	if ( fd < 0 ) return NULL;
+
+	if ( fstat( fd, &st ) != 0 || st.st_size < (off_t)sizeof(KeymapHeader) ||
+		 st.st_size > (off_t)( sizeof(KeymapHeader) + KEYMAP_MAX_CAPACITY * sizeof(KeymapEntry) ) )
+	{
+		close( fd );
+		return NULL;
+	}
+
+	// The mapping keeps the file alive, the descriptor isn't needed anymore.
+	view = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+
+	if ( view == MAP_FAILED ) return NULL;
+
+	if ( !input_is_keymap_valid( (const KeymapHeader*)view, (size_t)st.st_size ) )
+	{
+		munmap( view, (size_t)st.st_size );
+		return NULL;
+	}
+
+	return (const KeymapHeader*)view;
+}
+
+static void input_unmap_keymap( const KeymapHeader* map )
+{
+	if ( map != NULL ) munmap( (void*)map, KEYMAP_SIZE( map ) );
+}
+
+static bool input_replace_file( const char* from, const char* to )
+{
+	return rename( from, to ) == 0;
+}
+
+#endif /* _WIN32 */
+
+static const char* input_get_file_name( const char* path )
+{
+	const char* name = path;
+
+	for ( ; *path; path++ )
+	{
+		if ( *path == '/' || *path == '\\' ) name = path + 1;
+	}
+
+	return name;
+}
+
+// --------------------------------------------------
+
+static void input_stop_keymap_watch( void )
+{
+#ifdef _WIN32
+	if ( keymap_watch != NULL )
+	{
+		FindCloseChangeNotification( keymap_watch );
+		keymap_watch = NULL;
+	}
+#else
+	if ( keymap_watch >= 0 )
+	{
+		close( keymap_watch );
+		keymap_watch = -1;
+	}
+#endif
+}
+
+static bool input_start_keymap_watch( void )
+{
+	char* dir;
+	size_t length;
+	bool ret;
+
+	input_stop_keymap_watch();
+
+	// The whole directory is watched because keymaps are replaced by renaming a new file over the old one.
+	length = (size_t)( input_get_file_name( keymap_path ) - keymap_path );
+
+	dir = mem_alloc( length + 2 );
+	memcpy( dir, keymap_path, length );
+	strcpy( dir + length, length ? "" : "." );
+
+#ifdef _WIN32
+	keymap_watch = FindFirstChangeNotificationA( dir, FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE|FILE_NOTIFY_CHANGE_FILE_NAME );
+
+	if ( keymap_watch == INVALID_HANDLE_VALUE ) keymap_watch = NULL;
+	ret = ( keymap_watch != NULL );
+#else
+	keymap_watch = inotify_init1( IN_NONBLOCK|IN_CLOEXEC );
+
+	if ( keymap_watch >= 0 && inotify_add_watch( keymap_watch, dir, IN_CLOSE_WRITE|IN_MOVED_TO ) < 0 )
+		input_stop_keymap_watch();
+
+	ret = ( keymap_watch >= 0 );
+#endif
+
+	mem_free( dir );
+
+	return ret;
+}
+
+static bool input_has_keymap_changed( void )
+{
+#ifdef _WIN32
+	// The notification doesn't say which file changed, so any change in the directory triggers a reload.
+	if ( WaitForSingleObject( keymap_watch, 0 ) != WAIT_OBJECT_0 ) return false;
+
+	FindNextChangeNotification( keymap_watch );
+
+	return true;
+#else
+	char buffer[4096] __attribute__(( aligned( __alignof__( struct inotify_event ) ) ));
+	const struct inotify_event* event;
+	const char* name;
+	ssize_t length;
+	char* p;
+	bool changed = false;
+
+	name = input_get_file_name( keymap_path );
+
+	// Drain everything that has been queued, only the keymap's own name is interesting.
+	while ( ( length = read( keymap_watch, buffer, sizeof(buffer) ) ) > 0 )
+	{
+		for ( p = buffer; p < buffer + length; p += sizeof(struct inotify_event) + event->len )
+		{
+			event = (const struct inotify_event*)p;
+			if ( event->len != 0 && strcmp( event->name, name ) == 0 ) changed = true;
+		}
+	}
+
+	return changed;
+#endif
+}
+
+static void input_reload_keymap( void )
+{
+	const KeymapHeader* map;
+
+	// A keymap that is broken or still being written doesn't replace the one that works.
+	map = input_map_keymap( keymap_path );
+	if ( map == NULL ) return;
+
+	input_unmap_keymap( keymap_exchange( map ) );
+}
+
+// --------------------------------------------------
+
+bool input_load_keymap( const char* path, keymap_func_t func, void* data )
+{
+	const KeymapHeader* map;
+	size_t length;
+	bool watching;
+
+	if ( path == NULL || func == NULL ) return false;
+
+	map = input_map_keymap( path );
+	if ( map == NULL ) return false;
+
+#ifdef _WIN32
+	watching = ( keymap_watch != NULL );
+#else
+	watching = ( keymap_watch >= 0 );
+#endif
+
+	length = strlen( path );
+
+	mem_free( keymap_path );
+	keymap_path = mem_alloc( length + 1 );
+	memcpy( keymap_path, path, length + 1 );
+
+	keymap_handler = func;
+	keymap_userdata = data;
+
+	input_unmap_keymap( keymap_exchange( map ) );
+
+	// Keep watching if the previous keymap was being watched, the file may be in a different directory though.
+	if ( watching ) input_start_keymap_watch();
+
+	input_update_listeners();
+
+	return true;
+}
+
+void input_unload_keymap( void )
+{
+	input_stop_keymap_watch();
+	input_unmap_keymap( keymap_exchange( NULL ) );
+
+	mem_free( keymap_path );
+
+	keymap_path = NULL;
+	keymap_handler = NULL;
+	keymap_userdata = NULL;
+
+	input_update_listeners();
+}
+
+bool input_watch_keymap( bool watch )
+{
+	if ( !watch )
+	{
+		input_stop_keymap_watch();
+		return true;
+	}
+
+	if ( keymap_path == NULL ) return false;
+
+	return input_start_keymap_watch();
+}
+
+bool input_is_keymap_loaded( void )
+{
+	return keymap_get() != NULL;
+}
+
+void input_keymap_shutdown( void )
+{
+	input_unload_keymap();
+}
+
+void input_poll_keymap( void )
+{
+	uint64 now;
+
+#ifdef _WIN32
+	if ( keymap_watch == NULL ) return;
+#else
+	if ( keymap_watch < 0 ) return;
+#endif
+
+	// Checking the watch is a system call, there's no need to make one for every event that comes in.
+	now = input_platform_get_time();
+	if ( now - keymap_polled < KEYMAP_POLL_INTERVAL ) return;
+
+	keymap_polled = now;
+
+	if ( input_has_keymap_changed() )
+		input_reload_keymap();
+}
+
+bool input_handle_keymap( INPUT_EVENT type, uint32 key )
+{
+	const KeymapHeader* map;
+	const KeymapEntry* entry;
+	uint32 action;
+	bool ret;
+
+	map = keymap_get();
+	if ( map == NULL ) return true;
+
+	// Chords are always stored in upper case, keys posted by the application may not be.
+	if ( key >= 'a' && key <= 'z' ) key -= ( 'a' - 'A' );
+
+	entry = input_find_chord( map, key, input_get_chord_modifiers(), type == INPUT_KEY_UP ? KEYMAP_UP : 0 );
+	if ( entry == NULL ) return true;
+
+	// The handler may unload or replace the keymap, the entry can't be touched after this.
+	action = entry->action;
+
+	INPUT_TRACE_BEGIN( "keymap", action );
+	ret = keymap_handler( action, keymap_userdata );
+	INPUT_TRACE_END();
+
+	return ret;
+}
+
+// --------------------------------------------------
+
+static bool input_is_name( const char* name, const char* s, size_t length )
+{
+	size_t i;
+
+	for ( i = 0; i < length; i++ )
+	{
+		if ( name[i] == 0 || name[i] != tolower( (unsigned char)s[i] ) ) return false;
+	}
+
+	return name[length] == 0;
+}
+
+static bool input_parse_key( const char* s, size_t length, uint32* key, uint8* modifiers )
+{
+	static const char shifted[] = "!@#$%^&*()_+{}|:\"<>?~";
+	static const char unshifted[] = "1234567890-=[]\\;',./`";
+	const char* c;
+	char* end;
+	uint32 i;
+
+	if ( length == 0 ) return false;
+
+	// A single character is the key with the same ASCII code (see KeyDefs.h), letters in upper case.
+	if ( length == 1 )
+	{
+		if ( !isgraph( (unsigned char)s[0] ) ) return false;
+
+		// Chords are matched by the unshifted key, which is the same for a press and its release. A shifted
+		// symbol is its key (on a US layout) with shift held down.
+		if ( ( c = strchr( shifted, s[0] ) ) != NULL )
+		{
+			*key = (uint32)unshifted[c - shifted];
+			*modifiers |= KEYMAP_SHIFT;
+			return true;
+		}
+
+		*key = (uint32)toupper( (unsigned char)s[0] );
+		return true;
+	}
+
+	for ( i = 0; i < sizeof(key_names) / sizeof(key_names[0]); i++ )
+	{
+		if ( input_is_name( key_names[i].name, s, length ) )
+		{
+			*key = key_names[i].key;
+			return true;
+		}
+	}
+
+	// Anything else can be bound with its platform specific key code.
+	if ( length > 2 && s[0] == '0' && ( s[1] == 'x' || s[1] == 'X' ) )
+	{
+		*key = (uint32)strtoul( s, &end, 16 );
+		return end == s + length;
+	}
+
+	return false;
+}
+
+static bool input_parse_chord( const char* s, KeymapEntry* entry )
+{
+	const char* part;
+	size_t length;
+
+	entry->modifiers = 0;
+
+	// Modifiers are joined to the key with '+', e.g. ctrl+shift+s.
+	for ( ;; )
+	{
+		part = s;
+		length = strcspn( s, "+" );
+
+		// A '+' right at the end of the chord is the key itself.
+		if ( s[length] == 0 || ( length == 0 && s[1] == 0 ) )
+			return input_parse_key( part, length ? length : 1, &entry->key, &entry->modifiers );
+
+		if ( input_is_name( "shift", part, length ) ) entry->modifiers |= KEYMAP_SHIFT;
+		else if ( input_is_name( "ctrl", part, length ) ) entry->modifiers |= KEYMAP_CONTROL;
+		else if ( input_is_name( "control", part, length ) ) entry->modifiers |= KEYMAP_CONTROL;
+		else if ( input_is_name( "alt", part, length ) ) entry->modifiers |= KEYMAP_ALT;
+		else return false;
+
+		s += length + 1;
+	}
+}
+
+static bool input_parse_keymap_line( char* line, KeymapEntry* entry, bool* empty )
+{
+	char *token, *end;
+
+	*empty = false;
+
+	// Everything after a '#' is a comment.
+	line[strcspn( line, "#" )] = 0;
+
+	// <action> [down|up] <chord>
+	token = strtok( line, " \t\r\n" );
+
+	if ( token == NULL )
+	{
+		*empty = true;
+		return true;
+	}
+
+	memset( entry, 0, sizeof(*entry) );
+
+	entry->action = (uint32)strtoul( token, &end, 0 );
+	entry->flags = KEYMAP_USED;
+
+	if ( *end != 0 || end == token ) return false;
+
+	token = strtok( NULL, " \t\r\n" );
+	if ( token == NULL ) return false;
+
+	if ( strcmp( token, "up" ) == 0 || strcmp( token, "down" ) == 0 )
+	{
+		if ( token[0] == 'u' ) entry->flags |= KEYMAP_UP;
+
+		token = strtok( NULL, " \t\r\n" );
+		if ( token == NULL ) return false;
+	}
+
+	if ( !input_parse_chord( token, entry ) ) return false;
+
+	return strtok( NULL, " \t\r\n" ) == NULL;
+}
+
+static bool input_insert_chord( KeymapEntry* entries, uint32 capacity, const KeymapEntry* chord )
+{
+	KeymapEntry* entry;
+	uint32 i;
+
+	for ( i = input_hash_chord( chord->key, chord->modifiers, chord->flags, capacity ); ; i = ( i + 1 ) & ( capacity - 1 ) )
+	{
+		entry = &entries[i];
+
+		if ( !( entry->flags & KEYMAP_USED ) ) break;
+
+		// The same chord can't trigger two actions.
+		if ( entry->key == chord->key && entry->modifiers == chord->modifiers &&
+			 ( entry->flags & KEYMAP_UP ) == ( chord->flags & KEYMAP_UP ) )
+			return false;
+	}
+
+	*entry = *chord;
+	return true;
+}
+
+static KeymapEntry* input_grow_chords( KeymapEntry* entries, uint32 capacity, uint32 new_capacity )
+{
+	KeymapEntry* table;
+	uint32 i;
+
+	table = mem_alloc( new_capacity * sizeof(*table) );
+	memset( table, 0, new_capacity * sizeof(*table) );
+
+	for ( i = 0; i < capacity; i++ )
+	{
+		if ( entries[i].flags & KEYMAP_USED ) input_insert_chord( table, new_capacity, &entries[i] );
+	}
+
+	mem_free( entries );
+
+	return table;
+}
+
+bool input_compile_keymap( const char* source, const char* path, uint32* error_line )
+{
+	FILE* file;
+	KeymapHeader header;
+	KeymapEntry* entries;
+	KeymapEntry entry;
+	char line[KEYMAP_MAX_LINE];
+	char* temp_path;
+	uint32 line_number = 0, capacity = KEYMAP_MIN_CAPACITY, count = 0;
+	bool empty, ret = false;
+
+	if ( error_line != NULL ) *error_line = 0;
+
+	file = fopen( source, "r" );
+	if ( file == NULL ) return false;
+
+	entries = mem_alloc( capacity * sizeof(*entries) );
+	memset( entries, 0, capacity * sizeof(*entries) );
+
+	while ( fgets( line, sizeof(line), file ) != NULL )
+	{
+		line_number++;
+
+		// Lines that don't fit into the buffer are errors rather than silently split in two.
+		if ( strchr( line, '\n' ) == NULL && !feof( file ) ) goto parse_error;
+		if ( !input_parse_keymap_line( line, &entry, &empty ) ) goto parse_error;
+
+		if ( empty ) continue;
+
+		// The table is kept at most half full so that lookups rarely probe more than an entry or two.
+		if ( ( count + 1 ) * 2 > capacity )
+		{
+			if ( capacity == KEYMAP_MAX_CAPACITY ) goto parse_error;
+
+			entries = input_grow_chords( entries, capacity, capacity * 2 );
+			capacity *= 2;
+		}
+
+		if ( !input_insert_chord( entries, capacity, &entry ) ) goto parse_error;
+
+		count++;
+	}
+
+	if ( ferror( file ) ) goto cleanup;
+
+	fclose( file );
+
+	header.magic = KEYMAP_MAGIC;
+	header.version = KEYMAP_VERSION;
+	header.platform = KEYMAP_PLATFORM;
+	header.count = count;
+	header.capacity = capacity;
+
+	// The keymap is written next to the target and then renamed over it, so a watcher never maps a half written file.
+	temp_path = mem_alloc( strlen( path ) + 5 );
+	strcpy( temp_path, path );
+	strcat( temp_path, ".tmp" );
+
+	file = fopen( temp_path, "wb" );
+
+	if ( file != NULL )
+	{
+		ret = fwrite( &header, sizeof(header), 1, file ) == 1 &&
+			  fwrite( entries, sizeof(*entries), capacity, file ) == capacity;
+
+		if ( fclose( file ) != 0 ) ret = false;
+		if ( ret ) ret = input_replace_file( temp_path, path );
+		if ( !ret ) remove( temp_path );
+	}
+
+	mem_free( temp_path );
+	mem_free( entries );
+
+	return ret;
+
+parse_error:
+	if ( error_line != NULL ) *error_line = line_number;
+
+cleanup:
+	fclose( file );
+	mem_free( entries );
+
+	return false;
+}
@@ -0,0 +1,127 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		InputPredict.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		A portable input hooker library.
+ *				Cursor position prediction.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#include "Input.h"
+#include "InputSys.h"
+
+// --------------------------------------------------
+
+/*
+ * An alpha-beta filter per axis: each sample corrects the predicted position by PREDICT_ALPHA of the error
+ * and the velocity by PREDICT_BETA of it. The filter state sums up the whole motion history, so both updates
+ * and predictions take the same few operations no matter how much input there has been. Times are in
+ * milliseconds to keep the velocities in a sensible range for floats.
+ */
+typedef struct {
+	float				position;	// Filtered position
+	float				velocity;	// Filtered velocity in pixels per millisecond
+} PredictAxis;
+
+#define PREDICT_ALPHA			0.5f
+#define PREDICT_BETA			0.1f
+#define PREDICT_RESET_NS		100000000ULL	// Motion restarts from rest after a pause this long
+#define PREDICT_IDLE_NS			50000000ULL		// The cursor is considered stopped after this long without motion
+#define PREDICT_MAX_AHEAD_NS	100000000ULL	// Predictions further ahead than this are clamped
+
+static bool			predict_enabled		= false;	// Are samples being fed to the filter
+static bool			predict_primed		= false;	// Has the filter seen a sample since it was reset
+static uint64		predict_time		= 0;		// Time of the last sample
+static PredictAxis	predict_axes[2];
+
+// --------------------------------------------------
+
+static void input_predict_axis( PredictAxis* axis, int16 sample, float dt )
+{
+	float error;
+
+	// Samples with the same timestamp (merged motion) only say where the cursor is, not how fast it moves.
+	if ( dt <= 0.0f )
+	{
+		axis->position += PREDICT_ALPHA * ( sample - axis->position );
+		return;
+	}
+
+	axis->position += axis->velocity * dt;
+	error = sample - axis->position;
+
+	axis->position += PREDICT_ALPHA * error;
+	axis->velocity += PREDICT_BETA * error / dt;
+}
+
+static int16 input_clamp_position( float value )
+{
+	if ( value <= -32768.0f ) return -32768;
+	if ( value >= 32767.0f ) return 32767;
+
+	return (int16)( value < 0 ? value - 0.5f : value + 0.5f );
+}
+
+void input_predict_sample( int16 x, int16 y, uint64 time )
+{
+	float dt;
+
+	if ( !predict_enabled ) return;
+
+	if ( !predict_primed || time - predict_time > PREDICT_RESET_NS )
+	{
+		predict_axes[0].position = x;
+		predict_axes[1].position = y;
+		predict_axes[0].velocity = 0.0f;
+		predict_axes[1].velocity = 0.0f;
+		predict_primed = true;
+	}
+	else
+	{
+		// Timestamps don't go backwards, but an event posted with an explicit time could make them.
+		dt = time > predict_time ? (float)( time - predict_time ) / 1000000.0f : 0.0f;
+
+		input_predict_axis( &predict_axes[0], x, dt );
+		input_predict_axis( &predict_axes[1], y, dt );
+	}
+
+	predict_time = time;
+}
+
+void input_enable_prediction( bool enable )
+{
+	// The filter is fed from motion events, which are only read when someone wants them.
+	if ( enable != predict_enabled )
+		input_add_consumer( INPUT_EVENT_BIT(INPUT_MOUSE_MOVE), enable );
+
+	predict_enabled = enable;
+	predict_primed = false;
+}
+
+bool input_predict_cursor( uint64 time, int16* x, int16* y )
+{
+	uint64 ahead;
+	float dt;
+
+	if ( x == NULL || y == NULL ) return false;
+
+	// A cursor that has stopped stays where it is, whatever the velocity was when it stopped.
+	if ( !predict_primed || input_platform_get_time() - predict_time > PREDICT_IDLE_NS )
+	{
+		input_get_cursor_pos( x, y );
+		return predict_primed;
+	}
+
+	ahead = time > predict_time ? time - predict_time : 0;
+	if ( ahead > PREDICT_MAX_AHEAD_NS ) ahead = PREDICT_MAX_AHEAD_NS;
+
+	dt = (float)ahead / 1000000.0f;
+
+	*x = input_clamp_position( predict_axes[0].position + predict_axes[0].velocity * dt );
+	*y = input_clamp_position( predict_axes[1].position + predict_axes[1].velocity * dt );
+
+	return true;
+}
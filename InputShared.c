@@ -0,0 +1,329 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		InputShared.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		A portable input hooker library.
+ *				Input state published in shared memory.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#include "Input.h"
+#include "InputSys.h"
+#include "Platform/Alloc.h"
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// --------------------------------------------------
+
+/*
+ * The state is protected by a sequence lock: the publisher makes the sequence odd before it starts writing
+ * and even again when it's done. A reader copies the state and retries if the sequence was odd or changed
+ * while it was copying, so neither side ever waits for the other. There is only ever one publisher, the
+ * thread dispatching events.
+ */
+struct InputSharedRegion {
+	uint32				magic;		// SHARED_MAGIC
+	uint32				size;		// Size of the region, catches readers built against another version
+	volatile uint32		sequence;	// Odd while the state is being written
+	volatile uint32		active;		// Cleared when the publisher stops
+	InputSharedState	state;
+};
+
+#define SHARED_MAGIC			0x534E494D	// "MINS"
+#define SHARED_READ_RETRIES		1024		// Reads give up after this many torn copies
+
+#ifdef _WIN32
+#define shared_store(x, value)	( (x) = (value) )
+#define shared_load(x)			(x)
+#define shared_write_fence()	MemoryBarrier()
+#define shared_read_fence()		MemoryBarrier()
+#else
+#define shared_store(x, value)	__atomic_store_n( &(x), (value), __ATOMIC_RELAXED )
+#define shared_load(x)			__atomic_load_n( &(x), __ATOMIC_RELAXED )
+#define shared_write_fence()	__atomic_thread_fence( __ATOMIC_RELEASE )
+#define shared_read_fence()		__atomic_thread_fence( __ATOMIC_ACQUIRE )
+#endif
+
+// --------------------------------------------------
+
+static InputSharedRegion*	published_region	= NULL;		// Region the state is published in
+static InputSharedState		published_state;				// The state as it was last published
+#ifdef _WIN32
+static HANDLE				published_mapping	= NULL;		// Keeps the region alive while publishing
+#else
+static char*				published_name		= NULL;		// Name of the region, for unlinking it when done
+#endif
+
+// --------------------------------------------------
+
+#ifdef _WIN32
+
+static InputSharedRegion* input_create_region( const char* name )
+{
+	void* view;
+
+	published_mapping = CreateFileMappingA( INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(InputSharedRegion), name );
+	if ( published_mapping == NULL ) return NULL;
+
+	view = MapViewOfFile( published_mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(InputSharedRegion) );
+
+	if ( view == NULL )
+	{
+		CloseHandle( published_mapping );
+		published_mapping = NULL;
+	}
+
+	return (InputSharedRegion*)view;
+}
+
+static void input_destroy_region( InputSharedRegion* region )
+{
+	UnmapViewOfFile( region );
+	CloseHandle( published_mapping );
+	published_mapping = NULL;
+}
+
+static const InputSharedRegion* input_map_region( const char* name )
+{
+	HANDLE mapping;
+	void* view;
+
+	mapping = OpenFileMappingA( FILE_MAP_READ, FALSE, name );
+	if ( mapping == NULL ) return NULL;
+
+	// The view keeps the mapping alive on its own.
+	view = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, sizeof(InputSharedRegion) );
+	CloseHandle( mapping );
+
+	return (const InputSharedRegion*)view;
+}
+
+static void input_unmap_region( const InputSharedRegion* region )
+{
+	UnmapViewOfFile( (void*)region );
+}
+
+#else
+
+static InputSharedRegion* input_create_region( const char* name )
+{
+	void* view;
+	size_t length;
+	int fd;
+
+	// Only readers running as the same user get to see the input.
+	fd = shm_open( name, O_CREAT|O_RDWR|O_CLOEXEC, 0600 );
+	if ( fd < 0 ) return NULL;
+
+	if ( ftruncate( fd, sizeof(InputSharedRegion) ) != 0 )
+	{
+		close( fd );
+		shm_unlink( name );
+		return NULL;
+	}
+
+	view = mmap( NULL, sizeof(InputSharedRegion), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+
+	if ( view == MAP_FAILED )
+	{
+		shm_unlink( name );
+		return NULL;
+	}
+
+	length = strlen( name );
+
+	published_name = mem_alloc( length + 1 );
+	memcpy( published_name, name, length + 1 );
+
+	return (InputSharedRegion*)view;
+}
+
+static void input_destroy_region( InputSharedRegion* region )
+{
+	munmap( region, sizeof(InputSharedRegion) );
+
+	// Readers that have the region mapped keep it until they close it.
+	shm_unlink( published_name );
+	mem_free( published_name );
+	published_name = NULL;
+}
+
+static const InputSharedRegion* input_map_region( const char* name )
+{
+	struct stat st;
+	void* view;
+	int fd;
+
+	fd = shm_open( name, O_RDONLY|O_CLOEXEC, 0 );
+	if ( fd < 0 ) return NULL;
+
+	if ( fstat( fd, &st ) != 0 || st.st_size < (off_t)sizeof(InputSharedRegion) )
+	{
+		close( fd );
+		return NULL;
+	}
+
+	view = mmap( NULL, sizeof(InputSharedRegion), PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+
+	return view == MAP_FAILED ? NULL : (const InputSharedRegion*)view;
+}
+
+static void input_unmap_region( const InputSharedRegion* region )
+{
+	munmap( (void*)region, sizeof(InputSharedRegion) );
+}
+
+#endif
+
+// --------------------------------------------------
+
+static void input_write_region( void )
+{
+	InputSharedRegion* region = published_region;
+	uint32 sequence = region->sequence;
+
+	shared_store( region->sequence, sequence + 1 );
+	shared_write_fence();
+
+	memcpy( (void*)&region->state, &published_state, sizeof(published_state) );
+
+	shared_write_fence();
+	shared_store( region->sequence, sequence + 2 );
+}
+
+bool input_publish_state( const char* name )
+{
+	extern int16 mouse_x, mouse_y;
+	InputSharedRegion* region;
+
+	if ( published_region != NULL )
+	{
+		shared_store( published_region->active, 0 );
+
+		input_destroy_region( published_region );
+		published_region = NULL;
+
+		input_add_consumer( INPUT_STATE_EVENTS, false );
+	}
+
+	if ( name == NULL ) return true;
+
+	region = input_create_region( name );
+	if ( region == NULL ) return false;
+
+	// Keys pressed before publishing started are unknown, they show up as released until pressed again.
+	memset( &published_state, 0, sizeof(published_state) );
+
+	published_state.time = input_platform_get_time();
+	published_state.modifiers = input_get_modifiers();
+	published_state.buttons = input_get_mouse_buttons();
+	published_state.mouse_x = mouse_x;
+	published_state.mouse_y = mouse_y;
+
+	region->magic = SHARED_MAGIC;
+	region->size = sizeof(InputSharedRegion);
+	region->sequence = 0;
+
+	published_region = region;
+	input_write_region();
+
+	// The published state has to follow the input even when nothing is bound to it.
+	input_add_consumer( INPUT_STATE_EVENTS, true );
+
+	shared_write_fence();
+	shared_store( region->active, 1 );
+
+	return true;
+}
+
+void input_publish_event( INPUT_EVENT type, uint32 key, uint64 time )
+{
+	extern int16 mouse_x, mouse_y;
+	uint32 index;
+
+	if ( published_region == NULL ) return;
+
+	if ( type == INPUT_KEY_DOWN || type == INPUT_KEY_UP )
+	{
+		index = INPUT_SHARED_KEY( key );
+
+		if ( index < INPUT_SHARED_KEYS )
+		{
+			if ( type == INPUT_KEY_DOWN ) published_state.keys[index >> 5] |= 1u << ( index & 31 );
+			else published_state.keys[index >> 5] &= ~( 1u << ( index & 31 ) );
+		}
+	}
+
+	published_state.time = time;
+	published_state.events++;
+	published_state.modifiers = input_get_modifiers();
+	published_state.buttons = input_get_mouse_buttons();
+	published_state.mouse_x = mouse_x;
+	published_state.mouse_y = mouse_y;
+
+	input_write_region();
+}
+
+InputSharedRegion* input_open_shared_state( const char* name )
+{
+	const InputSharedRegion* region;
+
+	if ( name == NULL ) return NULL;
+
+	region = input_map_region( name );
+	if ( region == NULL ) return NULL;
+
+	if ( region->magic != SHARED_MAGIC || region->size != sizeof(InputSharedRegion) )
+	{
+		input_unmap_region( region );
+		return NULL;
+	}
+
+	return (InputSharedRegion*)region;
+}
+
+bool input_read_shared_state( const InputSharedRegion* region, InputSharedState* state )
+{
+	uint32 i, before, after;
+
+	if ( region == NULL || state == NULL ) return false;
+
+	for ( i = 0; i < SHARED_READ_RETRIES; i++ )
+	{
+		if ( !shared_load( region->active ) ) return false;
+
+		before = shared_load( region->sequence );
+		shared_read_fence();
+
+		if ( ( before & 1 ) == 0 )
+		{
+			memcpy( state, (const void*)&region->state, sizeof(*state) );
+
+			shared_read_fence();
+			after = shared_load( region->sequence );
+
+			if ( after == before ) return true;
+		}
+	}
+
+	return false;
+}
+
+void input_close_shared_state( InputSharedRegion* region )
+{
+	if ( region != NULL ) input_unmap_region( region );
+}
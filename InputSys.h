@@ -15,18 +15,129 @@
 
 #include "Input.h"
 
+// Bit of an input event type in a listener mask
+#define INPUT_EVENT_BIT(x)				( 1 << (x) )
+
+// Relaxed atomic counters for statistics, cheap enough to be always enabled
+#ifdef _WIN32
+#define input_stat_add(counter, n)		InterlockedExchangeAdd64( (volatile LONGLONG*)&(counter), (LONGLONG)(n) )
+#define input_stat_get(counter)			(uint64)InterlockedCompareExchange64( (volatile LONGLONG*)&(counter), 0, 0 )
+#else
+#define input_stat_add(counter, n)		__atomic_fetch_add( &(counter), (n), __ATOMIC_RELAXED )
+#define input_stat_get(counter)			__atomic_load_n( &(counter), __ATOMIC_RELAXED )
+#endif
+
+// Event tracing (see InputTrace.c), compiled out unless INPUT_TRACE is defined.
+// Spans are named with static strings, the argument is the event type, key or button depending on the span.
+#ifdef INPUT_TRACE
+#define INPUT_TRACE_BEGIN(name, arg)				input_trace_begin( name, arg )
+#define INPUT_TRACE_END()							input_trace_end()
+#define INPUT_TRACE_SPAN(name, arg, start, end)		input_trace_span( name, arg, start, end )
+#else
+#define INPUT_TRACE_BEGIN(name, arg)
+#define INPUT_TRACE_END()
+#define INPUT_TRACE_SPAN(name, arg, start, end)
+#endif
+
+void	input_trace_begin				( const char* name, uint32 arg );
+void	input_trace_end					( void );
+void	input_trace_span				( const char* name, uint32 arg, uint64 start, uint64 end );
+void	input_trace_shutdown			( void );
+
+// A platform independent input event, either waiting in the queue or being dispatched directly.
+// The tick resampler keeps copies of them too (see InputTicks.c).
+typedef struct {
+	uint64				time;		// Time the event was received (see input_platform_get_time)
+	uint32				key;		// Key or character (keyboard events)
+	uint32				state_key;	// Key as tracked in the key state, the same for a press and its release
+	uint32				character;	// Character produced by a key press, dispatched after the key if it wasn't consumed
+	int16				x, y;		// Cursor position, or cursor movement for relative motion (mouse events)
+	uint8				type;		// Type of the event (INPUT_EVENT)
+	uint8				flags;		// See QUEUED_* flags below
+	uint8				button;		// Mouse button (MOUSEBTN)
+	uint8				wheel;		// Mouse wheel movement (MOUSEWHEEL)
+	uint8				modifiers;	// Modifier keys held down (MODIFIER)
+	uint8				buttons;	// Mouse buttons held down (MOUSEMASK)
+} QueuedEvent;
+
+#define QUEUED_RELATIVE			0x01	// Relative motion from a locked pointer
+
 // Input processing functions used by platform specific implementation
 bool	input_handle_keyboard_event		( INPUT_EVENT type, uint32 key );
 bool	input_handle_mouse_event		( INPUT_EVENT type, int16 x, int16 y, MOUSEBTN button, MOUSEWHEEL wheel );
+bool	input_handle_relative_mouse_event	( int16 dx, int16 dy );
 bool	input_handle_char_bind			( uint32 key );
 bool	input_handle_key_up_bind		( uint32 key );
 bool	input_handle_key_down_bind		( uint32 key );
 bool	input_handle_mouse_move_bind	( int16 x, int16 y );
 bool	input_handle_mouse_up_bind		( MOUSEBTN button, int16 x, int16 y );
 bool	input_handle_mouse_down_bind	( MOUSEBTN button, int16 x, int16 y );
+bool	input_has_listeners				( INPUT_EVENT type );
+void	input_update_listeners			( void );
+void	input_add_consumer				( uint32 events, bool add );
+void	input_count_dropped				( INPUT_EVENT type );
+
+// Every event that changes the key, button or cursor state
+#define INPUT_STATE_EVENTS				( ~INPUT_EVENT_BIT(INPUT_CHARACTER) & ( INPUT_EVENT_BIT(NUM_INPUT_EVENTS) - 1 ) )
+
+// Precompiled keymaps (see InputKeymap.c)
+bool	input_handle_keymap				( INPUT_EVENT type, uint32 key );
+void	input_poll_keymap				( void );
+bool	input_is_keymap_loaded			( void );
+void	input_keymap_shutdown			( void );
+
+// A parallel bind handler call, either key_handler or mouse_handler is set (see InputWorkers.c)
+typedef struct {
+	keybind_func_t		key_handler;
+	mousebind_func_t	mouse_handler;
+	void*				userdata;
+} InputJob;
+
+// Worker pool for parallel binds. The jobs run between begin and finish, and finish returns false if any
+// handler did. Only one batch can be running at a time, input_has_workers returns false while one is.
+bool	input_has_workers				( void );
+void	input_begin_jobs				( const InputJob* jobs, uint32 count, uint32 key, MOUSEBTN button, int16 x, int16 y );
+bool	input_finish_jobs				( void );
+
+// Updates the shared input state after an event has been dispatched (see InputShared.c)
+void	input_publish_event				( INPUT_EVENT type, uint32 key, uint64 time );
+
+// Records a dispatched event for the fixed-timestep ticks (see InputTicks.c)
+void	input_resample_event			( const QueuedEvent* event );
+
+// Feeds a cursor position to the predictor (see InputPredict.c)
+void	input_predict_sample			( int16 x, int16 y, uint64 time );
+
+// Events received by the platform implementation, dispatched directly or queued depending on the dispatch mode
+bool	input_post_keyboard_event		( INPUT_EVENT type, uint32 key, uint32 character );
+bool	input_post_key_event			( INPUT_EVENT type, uint32 key, uint32 state_key, uint32 character );
+bool	input_post_mouse_event			( INPUT_EVENT type, int16 x, int16 y, MOUSEBTN button, MOUSEWHEEL wheel );
+bool	input_post_relative_mouse_event	( int16 dx, int16 dy );
+void	input_set_event_state			( uint32 modifiers, uint32 buttons );
+void	input_set_event_time			( uint64 time );
+bool	input_is_dispatch_queued		( void );
 
 // Platform specific library initializers
 void	input_platform_initialize		( void* window );
 void	input_platform_shutdown			( void );
 
+// Grabs the pointer for a capturing bind so that motion keeps coming outside the window (see input_capture_mouse)
+void	input_platform_capture_pointer	( bool capture );
+
+// Background input thread (see INPUT_INIT_THREAD)
+bool	input_platform_start_thread		( void );
+void	input_platform_stop_thread		( void );
+
+// Processes a native window system event (called by input_process)
+bool	input_platform_process			( void* data );
+
+// Sleeps until input, another window system event or one of the handles arrives, then processes the input (see INPUT_WAIT)
+uint32	input_platform_wait				( uint64 timeout_ns, const input_wait_t* handles, uint32 count );
+
+// Monotonic time in nanoseconds
+uint64	input_platform_get_time			( void );
+
+// Notifies the platform implementation that the set of hooked/bound input events has changed
+void	input_platform_set_listeners	( uint32 events );
+
 #endif /* __MYLLY_INPUT_SYS_H */
@@ -0,0 +1,188 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		InputTicks.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		A portable input hooker library.
+ *				Resampling of input events into fixed-timestep ticks.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#include "Input.h"
+#include "InputSys.h"
+#include "Platform/Alloc.h"
+#include <string.h>
+
+// --------------------------------------------------
+
+/*
+ * Dispatched events are kept in a ring buffer until the tick they belong to is read. Ticks are built when
+ * they're read rather than when the events arrive, so unread ticks cost nothing but the events in them.
+ */
+#define TICK_QUEUE_SIZE			4096	// Events kept for unread ticks (a power of two)
+
+static QueuedEvent*	tick_events		= NULL;		// Ring buffer of events waiting for their tick to be read
+static uint32		tick_head		= 0;		// Index of the oldest event in the ring buffer
+static uint32		tick_count		= 0;		// Number of events in the ring buffer
+static uint32		tick_dropped	= 0;		// Events dropped since the last tick was read
+static uint64		tick_length		= 0;		// Length of a tick in nanoseconds, 0 when not resampling
+static uint64		tick_start		= 0;		// Start time of the oldest unread tick
+static uint64		tick_index		= 0;		// Number of the oldest unread tick
+static int16		tick_x			= 0;		// Cursor position as of the last event taken into a tick
+static int16		tick_y			= 0;
+
+// --------------------------------------------------
+
+bool input_start_ticks( uint64 tick_ns, uint64 start_time )
+{
+	extern int16 mouse_x, mouse_y;
+
+	if ( tick_ns == 0 ) return false;
+
+	if ( tick_events == NULL )
+		tick_events = mem_alloc( TICK_QUEUE_SIZE * sizeof(*tick_events) );
+
+	// Ticks need every transition whether or not anything is bound to it.
+	if ( tick_length == 0 )
+		input_add_consumer( INPUT_STATE_EVENTS, true );
+
+	tick_head = 0;
+	tick_count = 0;
+	tick_dropped = 0;
+	tick_length = tick_ns;
+	tick_start = start_time ? start_time : input_platform_get_time();
+	tick_index = 0;
+	tick_x = mouse_x;
+	tick_y = mouse_y;
+
+	return true;
+}
+
+void input_stop_ticks( void )
+{
+	if ( tick_length != 0 )
+		input_add_consumer( INPUT_STATE_EVENTS, false );
+
+	mem_free( tick_events );
+
+	tick_events = NULL;
+	tick_length = 0;
+	tick_count = 0;
+}
+
+void input_resample_event( const QueuedEvent* event )
+{
+	QueuedEvent* tail;
+
+	if ( tick_length == 0 ) return;
+
+	// Characters are derived from the key presses, which are already in the ticks.
+	if ( event->type == INPUT_CHARACTER ) return;
+
+	if ( tick_count == TICK_QUEUE_SIZE )
+	{
+		// Nobody is reading the ticks. Motion can still be merged into the last event, the rest is lost.
+		tail = &tick_events[( tick_head + tick_count - 1 ) & ( TICK_QUEUE_SIZE - 1 )];
+
+		if ( event->type == INPUT_MOUSE_MOVE && tail->type == INPUT_MOUSE_MOVE && event->flags == tail->flags )
+		{
+			if ( event->flags & QUEUED_RELATIVE )
+			{
+				tail->x += event->x;
+				tail->y += event->y;
+			}
+			else
+			{
+				tail->x = event->x;
+				tail->y = event->y;
+			}
+
+			tail->time = event->time;
+			return;
+		}
+
+		tick_dropped++;
+		return;
+	}
+
+	tick_events[( tick_head + tick_count ) & ( TICK_QUEUE_SIZE - 1 )] = *event;
+	tick_count++;
+}
+
+bool input_read_tick( InputTick* tick )
+{
+	const QueuedEvent* event;
+	InputTransition* transition;
+	uint64 end;
+
+	if ( tick == NULL || tick_length == 0 ) return false;
+
+	end = tick_start + tick_length;
+	if ( input_platform_get_time() < end ) return false;
+
+	tick->index = tick_index;
+	tick->start = tick_start;
+	tick->end = end;
+	tick->dx = 0;
+	tick->dy = 0;
+	tick->wheel = 0;
+	tick->dropped = tick_dropped;
+	tick->num_transitions = 0;
+
+	// Events dispatched after their own tick was read have a timestamp in the past, they go to this tick.
+	while ( tick_count != 0 )
+	{
+		event = &tick_events[tick_head];
+		if ( event->time >= end ) break;
+
+		// The tick is full, the rest of the events wait for the next one so they stay in order.
+		if ( event->type != INPUT_MOUSE_MOVE && event->type != INPUT_MOUSE_WHEEL &&
+			 tick->num_transitions == INPUT_TICK_MAX_TRANSITIONS ) break;
+
+		switch ( event->type )
+		{
+		case INPUT_MOUSE_MOVE:
+			if ( event->flags & QUEUED_RELATIVE )
+			{
+				tick->dx += event->x;
+				tick->dy += event->y;
+				break;
+			}
+
+			tick->dx += event->x - tick_x;
+			tick->dy += event->y - tick_y;
+			tick_x = event->x;
+			tick_y = event->y;
+			break;
+
+		case INPUT_MOUSE_WHEEL:
+			if ( event->wheel == MWHEEL_UP ) tick->wheel++;
+			else if ( event->wheel == MWHEEL_DOWN ) tick->wheel--;
+			break;
+
+		default:
+			transition = &tick->transitions[tick->num_transitions++];
+			transition->time = event->time;
+			// Keys go by the same key for the press and the release, like the shared state does.
+			transition->key = ( event->type == INPUT_KEY_DOWN || event->type == INPUT_KEY_UP ) ? event->state_key : event->button;
+			transition->type = event->type;
+			transition->modifiers = event->modifiers;
+			transition->buttons = event->buttons;
+			break;
+		}
+
+		tick_head = ( tick_head + 1 ) & ( TICK_QUEUE_SIZE - 1 );
+		tick_count--;
+	}
+
+	tick->mouse_x = tick_x;
+	tick->mouse_y = tick_y;
+
+	tick_dropped = 0;
+	tick_start = end;
+	tick_index++;
+
+	return true;
+}
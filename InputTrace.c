@@ -0,0 +1,206 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		InputTrace.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		A portable input hooker library.
+ *				Event tracing in the Chrome trace event format.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#include "Input.h"
+#include "InputSys.h"
+
+#ifdef INPUT_TRACE
+
+#include "Platform/Alloc.h"
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#define input_trace_get_pid() (uint32)GetCurrentProcessId()
+#else
+#include <unistd.h>
+#define input_trace_get_pid() (uint32)getpid()
+#endif
+
+// --------------------------------------------------
+
+// A finished span
+typedef struct {
+	const char*			name;		// Static string, never copied
+	uint32				arg;
+	uint64				start;		// Monotonic nanoseconds (see input_platform_get_time)
+	uint64				end;
+} TraceSpan;
+
+// A span which has been started but not finished
+typedef struct {
+	const char*			name;		// NULL if the span isn't recorded
+	uint32				arg;
+	uint64				start;
+} OpenSpan;
+
+#define TRACE_STACK_DEPTH		32
+
+// --------------------------------------------------
+
+static bool			trace_enabled		= false;	// Are spans being recorded
+static TraceSpan*	trace_spans			= NULL;		// Preallocated buffer for finished spans
+static uint32		trace_capacity		= 0;		// Size of the span buffer
+static uint32		trace_count			= 0;		// Number of spans in the buffer
+static uint32		trace_dropped		= 0;		// Number of spans that didn't fit into the buffer
+static OpenSpan		trace_stack[TRACE_STACK_DEPTH];	// Spans currently open, innermost last
+static uint32		trace_depth			= 0;		// Number of open spans (may exceed the stack, those aren't recorded)
+
+// --------------------------------------------------
+
+bool input_trace_start( uint32 capacity )
+{
+	if ( capacity == 0 ) return false;
+
+	// All the memory is allocated here, recording a span never allocates.
+	if ( capacity != trace_capacity )
+	{
+		mem_free( trace_spans );
+
+		trace_spans = mem_alloc( capacity * sizeof(*trace_spans) );
+		trace_capacity = capacity;
+	}
+
+	trace_count = 0;
+	trace_dropped = 0;
+	trace_enabled = true;
+
+	return true;
+}
+
+void input_trace_stop( void )
+{
+	trace_enabled = false;
+}
+
+void input_trace_shutdown( void )
+{
+	mem_free( trace_spans );
+
+	trace_spans = NULL;
+	trace_capacity = 0;
+	trace_count = 0;
+	trace_enabled = false;
+}
+
+void input_trace_begin( const char* name, uint32 arg )
+{
+	OpenSpan* span;
+
+	if ( trace_depth < TRACE_STACK_DEPTH )
+	{
+		span = &trace_stack[trace_depth];
+		span->name = trace_enabled ? name : NULL;
+		span->arg = arg;
+		span->start = trace_enabled ? input_platform_get_time() : 0;
+	}
+
+	trace_depth++;
+}
+
+void input_trace_end( void )
+{
+	OpenSpan* span;
+
+	if ( trace_depth == 0 ) return;
+	if ( --trace_depth >= TRACE_STACK_DEPTH ) return;
+
+	span = &trace_stack[trace_depth];
+
+	if ( span->name != NULL )
+		input_trace_span( span->name, span->arg, span->start, input_platform_get_time() );
+}
+
+void input_trace_span( const char* name, uint32 arg, uint64 start, uint64 end )
+{
+	TraceSpan* span;
+
+	if ( !trace_enabled ) return;
+
+	// When the buffer is full the newest spans are dropped, so the beginning of the trace stays intact.
+	if ( trace_count == trace_capacity )
+	{
+		trace_dropped++;
+		return;
+	}
+
+	span = &trace_spans[trace_count++];
+	span->name = name;
+	span->arg = arg;
+	span->start = start;
+	span->end = end;
+}
+
+bool input_trace_write( const char* path )
+{
+	FILE* file;
+	TraceSpan* span;
+	uint32 i, pid;
+	bool ret;
+
+	file = fopen( path, "w" );
+	if ( file == NULL ) return false;
+
+	pid = input_trace_get_pid();
+
+	// Timestamps are in microseconds of the monotonic clock, so the spans line up with other traces of the process.
+	fprintf( file, "{\"traceEvents\":[\n" );
+	fprintf( file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":0,\"args\":{\"name\":\"Input\"}}", pid );
+
+	for ( i = 0; i < trace_count; i++ )
+	{
+		span = &trace_spans[i];
+
+		fprintf( file, ",\n{\"name\":\"%s\",\"cat\":\"input\",\"ph\":\"X\",\"pid\":%u,\"tid\":0,"
+				 "\"ts\":%llu.%03u,\"dur\":%llu.%03u,\"args\":{\"arg\":%u}}",
+				 span->name, pid,
+				 (unsigned long long)( span->start / 1000 ), (uint32)( span->start % 1000 ),
+				 (unsigned long long)( ( span->end - span->start ) / 1000 ), (uint32)( ( span->end - span->start ) % 1000 ),
+				 span->arg );
+	}
+
+	fprintf( file, "\n],\"otherData\":{\"dropped\":\"%u\"}}\n", trace_dropped );
+
+	ret = !ferror( file );
+	fclose( file );
+
+	// The buffer is reused for the next batch of spans.
+	trace_count = 0;
+	trace_dropped = 0;
+
+	return ret;
+}
+
+#else /* INPUT_TRACE */
+
+// Tracing is compiled out, keep the API around so applications don't have to care.
+bool input_trace_start( uint32 capacity )
+{
+	UNREFERENCED_PARAM( capacity );
+	return false;
+}
+
+void input_trace_stop( void )
+{
+}
+
+bool input_trace_write( const char* path )
+{
+	UNREFERENCED_PARAM( path );
+	return false;
+}
+
+void input_trace_shutdown( void )
+{
+}
+
+#endif /* INPUT_TRACE */
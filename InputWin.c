@@ -19,10 +19,13 @@
 static HWND	hwnd = NULL;
 static WNDPROC old_proc = NULL;
 static bool input_hooked = false;
+static int16 lock_x = 0, lock_y = 0;	// Last known pointer position while the pointer is locked
+static int16 lock_w = 0, lock_h = 0;	// Size of the client area when the pointer was locked
 
 // --------------------------------------------------
 
 static LRESULT __stdcall input_process_hook( HWND wnd, UINT uMsg, WPARAM wParam, LPARAM lParam );
+static void input_warp_pointer( int16 x, int16 y );
 
 // --------------------------------------------------
 
@@ -44,6 +47,88 @@ void input_platform_shutdown( void )
 	hwnd = NULL;
 }
 
+uint64 input_platform_get_time( void )
+{
+	static LARGE_INTEGER frequency = { 0 };
+	LARGE_INTEGER counter;
+
+	if ( frequency.QuadPart == 0 )
+		QueryPerformanceFrequency( &frequency );
+
+	QueryPerformanceCounter( &counter );
+
+	// Split the conversion to avoid overflowing with high counter values.
+	return (uint64)( counter.QuadPart / frequency.QuadPart ) * 1000000000ULL +
+		   (uint64)( counter.QuadPart % frequency.QuadPart ) * 1000000000ULL / (uint64)frequency.QuadPart;
+}
+
+void input_platform_set_listeners( uint32 events )
+{
+	// Windows sends the messages regardless, there's no mask to update.
+	UNREFERENCED_PARAM( events );
+}
+
+void input_platform_capture_pointer( bool capture )
+{
+	extern bool pointer_locked;
+
+	// The pointer lock keeps the mouse captured for as long as it's active.
+	if ( pointer_locked ) return;
+
+	if ( capture ) SetCapture( hwnd );
+	else if ( GetCapture() == hwnd && input_get_mouse_buttons() == 0 ) ReleaseCapture();
+}
+
+bool input_platform_start_thread( void )
+{
+	// Window messages are only delivered to the thread which created the window, there's no reading them elsewhere.
+	return false;
+}
+
+void input_platform_stop_thread( void )
+{
+}
+
+uint32 input_platform_wait( uint64 timeout_ns, const input_wait_t* handles, uint32 count )
+{
+	MSG msg;
+	DWORD result, timeout;
+	uint32 ret = 0;
+
+	// The wait only knows milliseconds, round up so that we never wake up early.
+	if ( timeout_ns == INPUT_WAIT_FOREVER ) timeout = INFINITE;
+	else if ( timeout_ns / 1000000 >= INFINITE - 1 ) timeout = INFINITE - 1;
+	else timeout = (DWORD)( ( timeout_ns + 999999 ) / 1000000 );
+
+	// MWMO_INPUTAVAILABLE wakes up for messages that were already in the queue, not just new ones.
+	result = MsgWaitForMultipleObjectsEx( count, (const HANDLE*)handles, timeout, QS_ALLINPUT, MWMO_INPUTAVAILABLE );
+
+	if ( result == WAIT_FAILED ) return INPUT_WAIT_ERROR;
+
+	if ( ( result >= WAIT_OBJECT_0 && result < WAIT_OBJECT_0 + count ) ||
+		 ( result >= WAIT_ABANDONED_0 && result < WAIT_ABANDONED_0 + count ) )
+	{
+		ret |= INPUT_WAIT_HANDLES;
+	}
+
+	// Only input messages are taken out of the queue, everything else is left for the application.
+	while ( PeekMessage( &msg, hwnd, WM_KEYFIRST, WM_KEYLAST, PM_REMOVE ) ||
+			PeekMessage( &msg, hwnd, WM_MOUSEFIRST, WM_MOUSELAST, PM_REMOVE ) )
+	{
+		TranslateMessage( &msg );
+
+		// When the window procedure is hooked input_process gets called from there.
+		if ( input_hooked || input_process( &msg ) )
+			DispatchMessage( &msg );
+
+		ret |= INPUT_WAIT_INPUT;
+	}
+
+	if ( PeekMessage( &msg, NULL, 0, 0, PM_NOREMOVE ) ) ret |= INPUT_WAIT_EVENTS;
+
+	return ret;
+}
+
 void input_enable_hook( bool enable )
 {
 	if ( enable && !input_hooked )
@@ -60,54 +145,80 @@ void input_enable_hook( bool enable )
 	}
 }
 
-bool input_process( void* data )
+static void input_update_state( void )
+{
+	uint32 modifiers = 0, buttons = 0;
+
+	// GetKeyState returns the state as it was when the message being processed was generated,
+	// it doesn't query the current state of the device.
+	if ( GetKeyState( VK_LSHIFT ) & 0x8000 ) modifiers |= MODIFIER_LSHIFT;
+	if ( GetKeyState( VK_RSHIFT ) & 0x8000 ) modifiers |= MODIFIER_RSHIFT;
+	if ( GetKeyState( VK_LCONTROL ) & 0x8000 ) modifiers |= MODIFIER_LCONTROL;
+	if ( GetKeyState( VK_RCONTROL ) & 0x8000 ) modifiers |= MODIFIER_RCONTROL;
+	if ( GetKeyState( VK_LMENU ) & 0x8000 ) modifiers |= MODIFIER_LALT;
+	if ( GetKeyState( VK_RMENU ) & 0x8000 ) modifiers |= MODIFIER_RALT;
+
+	if ( GetKeyState( VK_LBUTTON ) & 0x8000 ) buttons |= MOUSEMASK_LBUTTON;
+	if ( GetKeyState( VK_MBUTTON ) & 0x8000 ) buttons |= MOUSEMASK_MBUTTON;
+	if ( GetKeyState( VK_RBUTTON ) & 0x8000 ) buttons |= MOUSEMASK_RBUTTON;
+
+	input_set_event_state( modifiers, buttons );
+}
+
+bool input_platform_process( void* data )
 {
+	extern bool pointer_locked;
+	extern int16 mouse_x, mouse_y;
 	MSG* msg;
+	MSG char_msg;
 	bool ret;
-	int16 x, y;
+	int16 x, y, dx, dy;
 
 	msg = (MSG*)data;
 
-	if ( data == NULL && input_hooked )
+	if ( data == NULL )
 	{
-		if ( hwnd && old_proc ) SetWindowLong( hwnd, GWL_WNDPROC, (LONG)input_process_hook );
+		// There's no message, only the window procedure hook gets installed again if it's enabled.
+		if ( input_hooked && hwnd && old_proc ) SetWindowLong( hwnd, GWL_WNDPROC, (LONG)input_process_hook );
 		return true;
 	}
 
+	if ( ( msg->message >= WM_KEYFIRST && msg->message <= WM_KEYLAST ) ||
+		 ( msg->message >= WM_MOUSEFIRST && msg->message <= WM_MOUSELAST ) )
+	{
+		input_update_state();
+	}
+
 	switch ( msg->message )
 	{
 	case WM_CHAR:
 		{
-			ret = input_handle_keyboard_event( INPUT_CHARACTER, (uint32)msg->wParam );
-			if ( ret )
-			{
-				ret = input_handle_char_bind( (uint32)msg->wParam );
-			}
+			// Characters are translated by the application's message loop anyway, but nobody has to see them.
+			if ( !input_has_listeners( INPUT_CHARACTER ) ) return true;
 
-			return ret;
+			return input_post_keyboard_event( INPUT_CHARACTER, (uint32)msg->wParam, 0 );
 		}
 
 	case WM_KEYUP:
 	case WM_SYSKEYUP:
 		{
-			ret = input_handle_keyboard_event( INPUT_KEY_UP, (uint32)msg->wParam );
-			if ( ret )
-			{
-				ret = input_handle_key_up_bind( (uint32)msg->wParam );
-			}
-
-			return ret;
+			return input_post_keyboard_event( INPUT_KEY_UP, (uint32)msg->wParam, 0 );
 		}
 
 	case WM_KEYDOWN:
 	case WM_SYSKEYDOWN:
 		{
-			ret = input_handle_keyboard_event( INPUT_KEY_DOWN, (uint32)msg->wParam );
-			if ( ret )
+			if ( input_is_dispatch_queued() )
 			{
-				ret = input_handle_key_down_bind( (uint32)msg->wParam );
+				// Whether the key press gets consumed isn't known until it's dispatched. Take the character
+				// along with the key like X11 does, dispatching drops it if the press is consumed.
+				if ( !PeekMessage( &char_msg, hwnd, WM_CHAR, WM_CHAR, PM_REMOVE ) ) char_msg.wParam = 0;
+
+				return input_post_keyboard_event( INPUT_KEY_DOWN, (uint32)msg->wParam, (uint32)char_msg.wParam );
 			}
 
+			ret = input_post_keyboard_event( INPUT_KEY_DOWN, (uint32)msg->wParam, 0 );
+
 			if ( !ret )
 			{
 				// This is here because the windows input model is retarded and also sends a WM_CHAR event for pressed down keys
@@ -122,117 +233,97 @@ bool input_process( void* data )
 			x = (int16)LOWORD(msg->lParam);
 			y = (int16)HIWORD(msg->lParam);
 
-			ret = input_handle_mouse_event( INPUT_MOUSE_MOVE, x, y, MOUSE_NONE, MWHEEL_STATIONARY );
-			if ( ret )
+			if ( pointer_locked )
 			{
-				ret = input_handle_mouse_move_bind( x, y );
+				// Windows merges mouse moves, so the message after a warp is likely to carry real motion on top of
+				// it. There's no telling the warp apart, motion is simply measured from where the warp put the pointer.
+				dx = x - lock_x;
+				dy = y - lock_y;
+
+				lock_x = x;
+				lock_y = y;
+
+				// Move the pointer back to the centre only when it gets close to the edges of the window.
+				if ( x < lock_w / 4 || x > 3 * lock_w / 4 || y < lock_h / 4 || y > 3 * lock_h / 4 )
+					input_warp_pointer( lock_w / 2, lock_h / 2 );
+
+				if ( dx == 0 && dy == 0 ) return false;
+
+				return input_post_relative_mouse_event( dx, dy );
 			}
 
-			return ret;
+			return input_post_mouse_event( INPUT_MOUSE_MOVE, x, y, MOUSE_NONE, MWHEEL_STATIONARY );
 		}
 
 	case WM_MOUSEWHEEL:
 		{
-			return input_handle_mouse_event( INPUT_MOUSE_WHEEL,
+			return input_post_mouse_event( INPUT_MOUSE_WHEEL,
 				(int16)LOWORD(msg->lParam), (int16)HIWORD(msg->lParam), MOUSE_NONE,
 				(float)((short)HIWORD((DWORD)msg->wParam)) > 0 ? MWHEEL_UP : MWHEEL_DOWN );
 		}
 
 	case WM_LBUTTONUP:
 		{
-			x = (int16)LOWORD(msg->lParam);
-			y = (int16)HIWORD(msg->lParam);
-
-			ReleaseCapture();
+			x = pointer_locked ? mouse_x : (int16)LOWORD(msg->lParam);
+			y = pointer_locked ? mouse_y : (int16)HIWORD(msg->lParam);
 
-			ret = input_handle_mouse_event( INPUT_LBUTTON_UP, x, y, MOUSE_LBUTTON, MWHEEL_STATIONARY );
-			if ( ret )
-			{
-				input_handle_mouse_up_bind( MOUSE_LBUTTON, x, y );
-			}
+			if ( !pointer_locked ) ReleaseCapture();
 
-			return ret;
+			return input_post_mouse_event( INPUT_LBUTTON_UP, x, y, MOUSE_LBUTTON, MWHEEL_STATIONARY );
 		}
 
 	case WM_LBUTTONDOWN:
 		{
-			x = (int16)LOWORD(msg->lParam);
-			y = (int16)HIWORD(msg->lParam);
-
-			SetCapture( msg->hwnd );
+			x = pointer_locked ? mouse_x : (int16)LOWORD(msg->lParam);
+			y = pointer_locked ? mouse_y : (int16)HIWORD(msg->lParam);
 
-			ret = input_handle_mouse_event( INPUT_LBUTTON_DOWN, x, y, MOUSE_LBUTTON, MWHEEL_STATIONARY );
-			if ( ret )
-			{
-				ret = input_handle_mouse_down_bind( MOUSE_LBUTTON, x, y );
-			}
+			if ( !pointer_locked ) SetCapture( msg->hwnd );
 
-			return ret;
+			return input_post_mouse_event( INPUT_LBUTTON_DOWN, x, y, MOUSE_LBUTTON, MWHEEL_STATIONARY );
 		}
 
 	case WM_MBUTTONUP:
 		{
-			x = (int16)LOWORD(msg->lParam);
-			y = (int16)HIWORD(msg->lParam);
+			x = pointer_locked ? mouse_x : (int16)LOWORD(msg->lParam);
+			y = pointer_locked ? mouse_y : (int16)HIWORD(msg->lParam);
 
-			ReleaseCapture();
-			ClipCursor( NULL );
-
-			ret = input_handle_mouse_event( INPUT_MBUTTON_UP, x, y, MOUSE_MBUTTON, MWHEEL_STATIONARY );
-			if ( ret )
+			if ( !pointer_locked )
 			{
-				ret = input_handle_mouse_up_bind( MOUSE_MBUTTON, x, y );
+				ReleaseCapture();
+				ClipCursor( NULL );
 			}
 
-			return ret;
+			return input_post_mouse_event( INPUT_MBUTTON_UP, x, y, MOUSE_MBUTTON, MWHEEL_STATIONARY );
 		}
 
 	case WM_MBUTTONDOWN:
 		{
-			x = (int16)LOWORD(msg->lParam);
-			y = (int16)HIWORD(msg->lParam);
+			x = pointer_locked ? mouse_x : (int16)LOWORD(msg->lParam);
+			y = pointer_locked ? mouse_y : (int16)HIWORD(msg->lParam);
 
-			SetCapture( msg->hwnd );
-
-			ret = input_handle_mouse_event( INPUT_MBUTTON_DOWN, x, y, MOUSE_MBUTTON, MWHEEL_STATIONARY );
-			if ( ret )
-			{
-				ret = input_handle_mouse_down_bind( MOUSE_MBUTTON, x, y );
-			}
+			if ( !pointer_locked ) SetCapture( msg->hwnd );
 
-			return ret;
+			return input_post_mouse_event( INPUT_MBUTTON_DOWN, x, y, MOUSE_MBUTTON, MWHEEL_STATIONARY );
 		}
 
 	case WM_RBUTTONUP:
 		{
-			x = (int16)LOWORD(msg->lParam);
-			y = (int16)HIWORD(msg->lParam);
+			x = pointer_locked ? mouse_x : (int16)LOWORD(msg->lParam);
+			y = pointer_locked ? mouse_y : (int16)HIWORD(msg->lParam);
 
-			ReleaseCapture();
+			if ( !pointer_locked ) ReleaseCapture();
 
-			ret = input_handle_mouse_event( INPUT_RBUTTON_UP, x, y, MOUSE_RBUTTON, MWHEEL_STATIONARY );
-			if ( ret )
-			{
-				ret = input_handle_mouse_up_bind( MOUSE_RBUTTON, x, y );
-			}
-
-			return ret;
+			return input_post_mouse_event( INPUT_RBUTTON_UP, x, y, MOUSE_RBUTTON, MWHEEL_STATIONARY );
 		}
 
 	case WM_RBUTTONDOWN:
 		{
-			x = (int16)LOWORD(msg->lParam);
-			y = (int16)HIWORD(msg->lParam);
+			x = pointer_locked ? mouse_x : (int16)LOWORD(msg->lParam);
+			y = pointer_locked ? mouse_y : (int16)HIWORD(msg->lParam);
 
-			SetCapture( msg->hwnd );
+			if ( !pointer_locked ) SetCapture( msg->hwnd );
 
-			ret = input_handle_mouse_event( INPUT_RBUTTON_DOWN, x, y, MOUSE_RBUTTON, MWHEEL_STATIONARY );
-			if ( ret )
-			{
-				ret = input_handle_mouse_down_bind( MOUSE_RBUTTON, x, y );
-			}
-
-			return ret;
+			return input_post_mouse_event( INPUT_RBUTTON_DOWN, x, y, MOUSE_RBUTTON, MWHEEL_STATIONARY );
 		}
 	}
 
@@ -295,6 +386,22 @@ void input_show_mouse_cursor_ref( bool show )
 	}
 }
 
+static void input_warp_pointer( int16 x, int16 y )
+{
+	POINT pt;
+
+	// Unlike input_set_cursor_pos this takes client coordinates.
+	pt.x = x;
+	pt.y = y;
+
+	ClientToScreen( hwnd, &pt );
+	SetCursorPos( pt.x, pt.y );
+
+	// SetCursorPos moves the cursor right away, motion from now on is relative to the new position.
+	lock_x = x;
+	lock_y = y;
+}
+
 void input_set_cursor_pos( int16 x, int16 y )
 {
 	extern int16 mouse_x, mouse_y;
@@ -305,4 +412,42 @@ void input_set_cursor_pos( int16 x, int16 y )
 	SetCursorPos( x, y );
 }
 
+void input_set_pointer_lock( bool lock )
+{
+	extern bool pointer_locked;
+	extern int16 mouse_x, mouse_y;
+	RECT rect;
+
+	if ( hwnd == NULL || lock == pointer_locked ) return;
+
+	if ( lock )
+	{
+		GetClientRect( hwnd, &rect );
+
+		lock_w = (int16)rect.right;
+		lock_h = (int16)rect.bottom;
+		lock_x = mouse_x;
+		lock_y = mouse_y;
+
+		// Hide the cursor and confine it to the client area for as long as the lock is active.
+		MapWindowPoints( hwnd, NULL, (POINT*)&rect, 2 );
+		ClipCursor( &rect );
+		SetCapture( hwnd );
+		ShowCursor( FALSE );
+
+		input_warp_pointer( lock_w / 2, lock_h / 2 );
+	}
+	else
+	{
+		ShowCursor( TRUE );
+		ReleaseCapture();
+		ClipCursor( NULL );
+
+		// Return the pointer to where it was when the lock was enabled.
+		input_warp_pointer( mouse_x, mouse_y );
+	}
+
+	pointer_locked = lock;
+}
+
 #endif /* _WIN32 */
@@ -0,0 +1,274 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		InputWorkers.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		A portable input hooker library.
+ *				Worker pool for running parallel bind handlers.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#include "Input.h"
+#include "InputSys.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// --------------------------------------------------
+
+/*
+ * The jobs of a batch are split into a contiguous range for each participant: the dispatching thread
+ * and every worker. A participant takes jobs from the front of its own range and, once it runs out,
+ * steals from the ranges of the others. Jobs are claimed with an atomic increment, so every job is run
+ * exactly once no matter who gets to it first. The batch stays open until the dispatching thread has
+ * seen every worker leave it, which is what makes it safe to reuse the ranges for the next batch.
+ */
+typedef struct {
+	volatile uint32		next;		// Next unclaimed job of the range (may run past the end)
+	uint32				end;		// End of the range
+	uint8				padding[56];	// Keep each range on a cache line of its own
+} JobRange;
+
+#define MAX_PARTICIPANTS	( INPUT_MAX_WORKERS + 1 )
+
+#ifdef _WIN32
+#define job_peek(range)			(range)->next
+#define job_claim(range)		(uint32)( InterlockedIncrement( (volatile LONG*)&(range)->next ) - 1 )
+#define job_fail()				InterlockedExchange( (volatile LONG*)&batch_result, 0 )
+typedef HANDLE					worker_thread_t;
+#else
+#define job_peek(range)			__atomic_load_n( &(range)->next, __ATOMIC_RELAXED )
+#define job_claim(range)		__atomic_fetch_add( &(range)->next, 1, __ATOMIC_ACQ_REL )
+#define job_fail()				__atomic_store_n( &batch_result, 0, __ATOMIC_RELAXED )
+typedef pthread_t				worker_thread_t;
+#endif
+
+// --------------------------------------------------
+
+static worker_thread_t	workers[INPUT_MAX_WORKERS];		// Worker threads
+static uint32			num_workers			= 0;		// Number of worker threads running
+static bool				quit_workers		= false;	// Are the workers being stopped
+
+static const InputJob*	batch_jobs			= NULL;		// Jobs of the current batch
+static uint32			batch_key			= 0;		// Arguments passed to every handler of the batch
+static MOUSEBTN			batch_button		= MOUSE_NONE;
+static int16			batch_x				= 0;
+static int16			batch_y				= 0;
+static volatile uint32	batch_result		= 1;		// Cleared when a handler returns false
+static uint32			batch_serial		= 0;		// Incremented for each batch, wakes up the workers
+static bool				batch_open			= false;	// Can workers join the current batch
+static uint32			batch_busy			= 0;		// Number of workers working on the current batch
+static JobRange			batch_ranges[MAX_PARTICIPANTS];
+
+#ifdef _WIN32
+static CRITICAL_SECTION		batch_lock;
+static CONDITION_VARIABLE	batch_start;
+static CONDITION_VARIABLE	batch_done;
+#else
+static pthread_mutex_t		batch_lock		= PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t		batch_start		= PTHREAD_COND_INITIALIZER;
+static pthread_cond_t		batch_done		= PTHREAD_COND_INITIALIZER;
+#endif
+
+// --------------------------------------------------
+
+#ifdef _WIN32
+#define batch_lock_acquire()	EnterCriticalSection( &batch_lock )
+#define batch_lock_release()	LeaveCriticalSection( &batch_lock )
+#define batch_wait(cond)		SleepConditionVariableCS( &(cond), &batch_lock, INFINITE )
+#define batch_wake_all(cond)	WakeAllConditionVariable( &(cond) )
+#define batch_wake(cond)		WakeConditionVariable( &(cond) )
+#else
+#define batch_lock_acquire()	pthread_mutex_lock( &batch_lock )
+#define batch_lock_release()	pthread_mutex_unlock( &batch_lock )
+#define batch_wait(cond)		pthread_cond_wait( &(cond), &batch_lock )
+#define batch_wake_all(cond)	pthread_cond_broadcast( &(cond) )
+#define batch_wake(cond)		pthread_cond_signal( &(cond) )
+#endif
+
+// --------------------------------------------------
+
+static void input_run_job( const InputJob* job )
+{
+	bool ret;
+
+	if ( job->key_handler != NULL )
+		ret = job->key_handler( batch_key, job->userdata );
+	else
+		ret = job->mouse_handler( batch_button, batch_x, batch_y, job->userdata );
+
+	if ( !ret ) job_fail();
+}
+
+static void input_run_jobs( uint32 participant )
+{
+	JobRange* range;
+	uint32 i, job;
+
+	// Own range first, then go through the others in order starting from the next participant.
+	for ( i = 0; i <= num_workers; i++ )
+	{
+		range = &batch_ranges[( participant + i ) % ( num_workers + 1 )];
+
+		while ( job_peek( range ) < range->end )
+		{
+			job = job_claim( range );
+			if ( job >= range->end ) break;
+
+			input_run_job( &batch_jobs[job] );
+		}
+	}
+}
+
+#ifdef _WIN32
+static DWORD WINAPI input_worker_main( LPVOID arg )
+#else
+static void* input_worker_main( void* arg )
+#endif
+{
+	uint32 participant = (uint32)(size_t)arg;
+	uint32 serial = 0;
+
+	batch_lock_acquire();
+
+	for ( ;; )
+	{
+		while ( !quit_workers && !( batch_open && batch_serial != serial ) )
+			batch_wait( batch_start );
+
+		if ( quit_workers ) break;
+
+		serial = batch_serial;
+		batch_busy++;
+
+		batch_lock_release();
+		input_run_jobs( participant );
+		batch_lock_acquire();
+
+		if ( --batch_busy == 0 ) batch_wake( batch_done );
+	}
+
+	batch_lock_release();
+
+	return 0;
+}
+
+// --------------------------------------------------
+
+bool input_start_workers( uint32 count )
+{
+	uint32 i;
+
+	if ( num_workers != 0 ) return false;
+	if ( count > INPUT_MAX_WORKERS ) count = INPUT_MAX_WORKERS;
+
+#ifdef _WIN32
+	InitializeCriticalSection( &batch_lock );
+	InitializeConditionVariable( &batch_start );
+	InitializeConditionVariable( &batch_done );
+#endif
+
+	quit_workers = false;
+
+	// The dispatching thread is participant 0, the workers come after it.
+	for ( i = 0; i < count; i++ )
+	{
+#ifdef _WIN32
+		workers[i] = CreateThread( NULL, 0, input_worker_main, (LPVOID)(size_t)( i + 1 ), 0, NULL );
+		if ( workers[i] == NULL ) break;
+#else
+		if ( pthread_create( &workers[i], NULL, input_worker_main, (void*)(size_t)( i + 1 ) ) != 0 ) break;
+#endif
+	}
+
+	num_workers = i;
+
+	return num_workers != 0;
+}
+
+void input_stop_workers( void )
+{
+	uint32 i;
+
+	if ( num_workers == 0 ) return;
+
+	batch_lock_acquire();
+	quit_workers = true;
+	batch_wake_all( batch_start );
+	batch_lock_release();
+
+	for ( i = 0; i < num_workers; i++ )
+	{
+#ifdef _WIN32
+		WaitForSingleObject( workers[i], INFINITE );
+		CloseHandle( workers[i] );
+#else
+		pthread_join( workers[i], NULL );
+#endif
+	}
+
+#ifdef _WIN32
+	DeleteCriticalSection( &batch_lock );
+#endif
+
+	num_workers = 0;
+}
+
+bool input_has_workers( void )
+{
+	return num_workers != 0 && !batch_open;
+}
+
+void input_begin_jobs( const InputJob* jobs, uint32 count, uint32 key, MOUSEBTN button, int16 x, int16 y )
+{
+	uint32 i, participants, share;
+
+	batch_jobs = jobs;
+	batch_key = key;
+	batch_button = button;
+	batch_x = x;
+	batch_y = y;
+	batch_result = 1;
+
+	participants = num_workers + 1;
+	share = count / participants;
+
+	// The first ranges get one job more when the jobs don't divide evenly.
+	for ( i = 0; i < participants; i++ )
+	{
+		batch_ranges[i].next = i * share + ( i < count % participants ? i : count % participants );
+		batch_ranges[i].end = batch_ranges[i].next + share + ( i < count % participants ? 1 : 0 );
+	}
+
+	if ( num_workers == 0 ) return;
+
+	batch_lock_acquire();
+	batch_serial++;
+	batch_open = true;
+	batch_wake_all( batch_start );
+	batch_lock_release();
+}
+
+bool input_finish_jobs( void )
+{
+	// Whatever the dispatching thread was doing is done, help out with the rest.
+	input_run_jobs( 0 );
+
+	if ( num_workers != 0 )
+	{
+		batch_lock_acquire();
+
+		while ( batch_busy != 0 )
+			batch_wait( batch_done );
+
+		batch_open = false;
+		batch_lock_release();
+	}
+
+	return batch_result != 0;
+}
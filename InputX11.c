@@ -18,11 +18,59 @@
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/XKBlib.h>
+#include <time.h>
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "Platform/Alloc.h"
 
 // --------------------------------------------------
 
 static syswindow_t* window = NULL;
 static uint32 modifier_flags = 0;
+static uint32 modifiers = 0;			// Modifier keys held down (see MODIFIER)
+static uint32 buttons = 0;				// Mouse buttons held down (see MOUSEMASK)
+static bool warp_pending = false;		// Is there a pointer warp we haven't seen the server process yet
+static unsigned long warp_serial = 0;	// Request serial of the last XWarpPointer call
+static int16 warp_x = 0, warp_y = 0;	// Position the pointer was warped to
+static int16 lock_x = 0, lock_y = 0;	// Last known pointer position while the pointer is locked
+static int16 lock_w = 0, lock_h = 0;	// Size of the window when the pointer was locked
+static bool input_hooked = false;		// Does the library select input events on the window
+static long app_event_mask = 0;			// Event mask the application had selected before hooking or starting the thread
+static bool app_mask_saved = false;		// Is app_event_mask the application's own mask
+static uint32 listeners = 0;			// Input events with at least one hook or bind
+
+// Input thread (see INPUT_INIT_THREAD). The thread reads events from a display connection of its own and passes them
+// to the main thread through a single producer, single consumer ring buffer.
+typedef struct {
+	XEvent event;
+	uint64 time;						// Time the event was read from the connection
+} ThreadEvent;
+
+#define INPUT_THREAD_QUEUE 2048			// Size of the ring buffer, must be a power of two
+
+static pthread_t input_thread;
+static bool thread_running = false;		// Has the input thread been started
+static Display* thread_display = NULL;	// Connection of the input thread (NULL when there's no thread)
+static ThreadEvent* thread_queue = NULL;
+static uint32 thread_head = 0;			// Next event to process, only written by the main thread
+static uint32 thread_tail = 0;			// Next free entry, only written by the input thread
+static bool thread_signaled = false;	// Has the main thread been woken up for the events in the queue
+static int thread_wake[2] = { -1, -1 };	// Pipe for telling the input thread to quit
+static int thread_notify[2] = { -1, -1 };	// Pipe for waking up input_wait when events arrive
+static bool processing_thread = false;	// Are events from the input thread being processed
+
+// Event mask bits only one client at a time can select on a window
+#define INPUT_EXCLUSIVE_MASK ButtonPressMask
+
+// --------------------------------------------------
+
+static void input_warp_pointer( int16 x, int16 y );
+static void input_select_events( void );
+static void input_save_app_mask( void );
+static void input_restore_app_mask( void );
 
 // --------------------------------------------------
 
@@ -33,27 +81,518 @@ void input_platform_initialize( void* wnd )
 
 void input_platform_shutdown( void )
 {
+	input_platform_stop_thread();
+	input_enable_hook( false );
 	window = NULL;
 }
 
+static bool input_signal_pipe( int fd )
+{
+	return write( fd, "", 1 ) == 1;
+}
+
+static bool input_wait_thread_room( uint32 tail, bool wait )
+{
+	struct pollfd fd;
+
+	while ( tail - __atomic_load_n( &thread_head, __ATOMIC_ACQUIRE ) == INPUT_THREAD_QUEUE )
+	{
+		if ( !wait ) return false;
+
+		// Sleep a little at a time, the thread still has to notice when it's told to quit.
+		fd.fd = thread_wake[0];
+		fd.events = POLLIN;
+		fd.revents = 0;
+
+		if ( poll( &fd, 1, 1 ) > 0 ) return false;
+	}
+
+	return true;
+}
+
+static void* input_thread_main( void* arg )
+{
+	struct pollfd fds[2];
+	ThreadEvent* item;
+	XEvent event;
+	uint64 time;
+	uint32 tail;
+
+	UNREFERENCED_PARAM( arg );
+
+	fds[0].fd = ConnectionNumber( thread_display );
+	fds[0].events = POLLIN;
+	fds[1].fd = thread_wake[0];
+	fds[1].events = POLLIN;
+
+	for ( ;; )
+	{
+		// Read everything that has arrived before going back to sleep.
+		while ( XPending( thread_display ) )
+		{
+			XNextEvent( thread_display, &event );
+			time = input_platform_get_time();
+
+			// Keep receiving motion while the left button is held down, even when the cursor leaves the window.
+			// The grab has to be made by this connection, otherwise the events would go to the application.
+			if ( event.type == ButtonPress && event.xbutton.button == Button1 )
+			{
+				XGrabPointer( thread_display, window->window, False, ButtonPressMask|ButtonReleaseMask|PointerMotionMask,
+							  GrabModeAsync, GrabModeAsync, window->window, None, CurrentTime );
+			}
+			else if ( event.type == ButtonRelease && event.xbutton.button == Button1 )
+			{
+				XUngrabPointer( thread_display, CurrentTime );
+			}
+
+			tail = thread_tail;
+
+			// The main thread is too far behind. Motion can go, the next motion event tells where the cursor
+			// is anyway, but anything else waits for room so that no press or release is ever lost.
+			if ( !input_wait_thread_room( tail, event.type != MotionNotify ) )
+			{
+				if ( event.type != MotionNotify ) return NULL;
+
+				input_count_dropped( INPUT_MOUSE_MOVE );
+				continue;
+			}
+
+			// The main thread processes the event with its own connection, ours isn't safe to use from there.
+			item = &thread_queue[tail & ( INPUT_THREAD_QUEUE - 1 )];
+			item->event = event;
+			item->event.xany.display = window->display;
+			item->time = time;
+
+			__atomic_store_n( &thread_tail, tail + 1, __ATOMIC_RELEASE );
+
+			// A full pipe means the main thread has been woken up already, so a failed write is fine.
+			if ( !__atomic_exchange_n( &thread_signaled, true, __ATOMIC_SEQ_CST ) )
+				input_signal_pipe( thread_notify[1] );
+		}
+
+		fds[0].revents = 0;
+		fds[1].revents = 0;
+
+		if ( poll( fds, 2, -1 ) < 0 && errno != EINTR ) break;
+
+		if ( fds[1].revents != 0 ) break;
+		if ( fds[0].revents & ( POLLERR|POLLHUP|POLLNVAL ) ) break;
+	}
+
+	return NULL;
+}
+
+static bool input_open_pipe( int* fds )
+{
+	if ( pipe( fds ) != 0 ) return false;
+
+	fcntl( fds[0], F_SETFL, O_NONBLOCK );
+	fcntl( fds[1], F_SETFL, O_NONBLOCK );
+
+	return true;
+}
+
+static void input_close_pipe( int* fds )
+{
+	if ( fds[0] >= 0 ) close( fds[0] );
+	if ( fds[1] >= 0 ) close( fds[1] );
+
+	fds[0] = fds[1] = -1;
+}
+
+bool input_platform_start_thread( void )
+{
+	if ( window == NULL || thread_display != NULL ) return false;
+
+	thread_display = XOpenDisplay( DisplayString( window->display ) );
+	if ( thread_display == NULL ) return false;
+
+	if ( !input_open_pipe( thread_wake ) || !input_open_pipe( thread_notify ) )
+	{
+		input_close_pipe( thread_wake );
+		input_close_pipe( thread_notify );
+
+		XCloseDisplay( thread_display );
+		thread_display = NULL;
+
+		return false;
+	}
+
+	thread_queue = mem_alloc( INPUT_THREAD_QUEUE * sizeof(*thread_queue) );
+	thread_head = 0;
+	thread_tail = 0;
+	thread_signaled = false;
+
+	// Only one client at a time can select button presses on a window, so those move from the application's
+	// connection to the thread's one. The application keeps everything else it had selected.
+	input_save_app_mask();
+
+	XSelectInput( window->display, window->window, app_event_mask & ~INPUT_EXCLUSIVE_MASK );
+	XSync( window->display, False );
+
+	XSelectInput( thread_display, window->window, KeyPressMask|KeyReleaseMask|ButtonPressMask|ButtonReleaseMask|PointerMotionMask );
+	XSync( thread_display, False );
+
+	if ( pthread_create( &input_thread, NULL, input_thread_main, NULL ) != 0 )
+	{
+		input_platform_stop_thread();
+		return false;
+	}
+
+	thread_running = true;
+	return true;
+}
+
+void input_platform_stop_thread( void )
+{
+	if ( thread_display == NULL ) return;
+
+	if ( thread_running )
+	{
+		// The wake pipe is empty until now, so the write can't fail.
+		if ( input_signal_pipe( thread_wake[1] ) )
+			pthread_join( input_thread, NULL );
+
+		thread_running = false;
+	}
+
+	XCloseDisplay( thread_display );
+	thread_display = NULL;
+
+	input_close_pipe( thread_wake );
+	input_close_pipe( thread_notify );
+
+	mem_free( thread_queue );
+	thread_queue = NULL;
+
+	// Give the input events back to the application's connection.
+	if ( input_hooked ) input_select_events();
+	else input_restore_app_mask();
+}
+
+static void input_process_thread_events( void )
+{
+	ThreadEvent* item;
+	uint32 head, tail;
+	char buf[16];
+
+	if ( thread_display == NULL ) return;
+
+	// Events queued after this point will wake input_wait up again.
+	while ( read( thread_notify[0], buf, sizeof(buf) ) > 0 );
+	__atomic_store_n( &thread_signaled, false, __ATOMIC_SEQ_CST );
+
+	tail = __atomic_load_n( &thread_tail, __ATOMIC_ACQUIRE );
+	processing_thread = true;
+
+	for ( head = thread_head; head != tail; head++ )
+	{
+		item = &thread_queue[head & ( INPUT_THREAD_QUEUE - 1 )];
+
+		// The events keep the time they arrived at, not the time they're processed at.
+		input_set_event_time( item->time );
+		input_platform_process( &item->event );
+
+		// Hand the entry back to the input thread only once it's no longer needed.
+		__atomic_store_n( &thread_head, head + 1, __ATOMIC_RELEASE );
+	}
+
+	processing_thread = false;
+	input_set_event_time( 0 );
+}
+
+uint64 input_platform_get_time( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64)ts.tv_sec * 1000000000ULL + (uint64)ts.tv_nsec;
+}
+
+void input_platform_set_listeners( uint32 events )
+{
+	listeners = events;
+
+	if ( input_hooked )
+		input_select_events();
+}
+
+void input_platform_capture_pointer( bool capture )
+{
+	extern bool pointer_locked;
+
+	// The pointer lock holds a grab of its own, and the input thread grabs the pointer on its own connection.
+	if ( pointer_locked || thread_display != NULL ) return;
+
+	if ( capture )
+	{
+		XGrabPointer( window->display, window->window, False, ButtonPressMask|ButtonReleaseMask|
+						PointerMotionMask|FocusChangeMask|EnterWindowMask|LeaveWindowMask,
+						GrabModeAsync, GrabModeAsync, window->window, None, CurrentTime );
+	}
+	else if ( !( buttons & MOUSEMASK_LBUTTON ) )
+	{
+		// A held down left button keeps its grab until it's released.
+		XUngrabPointer( window->display, CurrentTime );
+	}
+}
+
+static Bool input_is_input_event( Display* display, XEvent* event, XPointer arg )
+{
+	UNREFERENCED_PARAM( display );
+	UNREFERENCED_PARAM( arg );
+
+	switch ( event->type )
+	{
+	case KeyPress:
+	case KeyRelease:
+	case ButtonPress:
+	case ButtonRelease:
+	case MotionNotify:
+		// With the input thread running these are the application's own copies, the thread reads ours.
+		return event->xany.window == window->window && thread_display == NULL;
+	}
+
+	return False;
+}
+
+uint32 input_platform_wait( uint64 timeout_ns, const input_wait_t* handles, uint32 count )
+{
+	struct pollfd fds[INPUT_WAIT_MAX_HANDLES + 2];
+	XEvent event;
+	uint32 i, ret = 0;
+	int timeout;
+
+	if ( window == NULL ) return INPUT_WAIT_ERROR;
+
+	fds[0].fd = ConnectionNumber( window->display );
+	fds[0].events = POLLIN;
+	fds[0].revents = 0;
+
+	for ( i = 0; i < count; i++ )
+	{
+		fds[i + 1].fd = handles[i];
+		fds[i + 1].events = POLLIN;
+		fds[i + 1].revents = 0;
+	}
+
+	// The input thread wakes us up through a pipe (poll ignores a negative fd when there's no thread).
+	fds[count + 1].fd = thread_notify[0];
+	fds[count + 1].events = POLLIN;
+	fds[count + 1].revents = 0;
+
+	// poll only knows milliseconds, round up so that we never wake up early.
+	if ( timeout_ns == INPUT_WAIT_FOREVER ) timeout = -1;
+	else if ( timeout_ns / 1000000 >= 0x7FFFFFFF ) timeout = 0x7FFFFFFF;
+	else timeout = (int)( ( timeout_ns + 999999 ) / 1000000 );
+
+	// Events Xlib has already read from the connection don't make it readable again, so don't go to sleep with any.
+	if ( XEventsQueued( window->display, QueuedAfterFlush ) != 0 ) timeout = 0;
+
+	if ( poll( fds, count + 2, timeout ) < 0 && errno != EINTR ) return INPUT_WAIT_ERROR;
+
+	if ( fds[0].revents & ( POLLERR|POLLHUP|POLLNVAL ) ) return INPUT_WAIT_ERROR;
+	if ( fds[0].revents & POLLIN ) XEventsQueued( window->display, QueuedAfterReading );
+
+	for ( i = 0; i < count; i++ )
+	{
+		if ( fds[i + 1].revents != 0 ) ret |= INPUT_WAIT_HANDLES;
+	}
+
+	if ( fds[count + 1].revents & POLLIN )
+	{
+		input_process( NULL );
+		ret |= INPUT_WAIT_INPUT;
+	}
+
+	// Only input events are taken out of the queue, everything else is left for the application.
+	while ( XCheckIfEvent( window->display, &event, input_is_input_event, NULL ) )
+	{
+		input_process( &event );
+		ret |= INPUT_WAIT_INPUT;
+	}
+
+	if ( XEventsQueued( window->display, QueuedAlready ) != 0 ) ret |= INPUT_WAIT_EVENTS;
+
+	return ret;
+}
+
 void input_enable_hook( bool enable )
 {
-	// We actually don't have a working hook for X window system... yet.
-	UNREFERENCED_PARAM( enable );
+	// There's no way to hook into the event loop of the application under X, so 'hooking' means that the library
+	// manages the input part of the event mask of the window. Only events which something listens to are selected,
+	// which saves the X server from sending (and us from reading) events nobody cares about.
+	if ( window == NULL ) return;
+
+	if ( enable && !input_hooked )
+	{
+		input_save_app_mask();
+
+		input_hooked = true;
+		input_select_events();
+	}
+	else if ( !enable && input_hooked )
+	{
+		input_hooked = false;
+
+		// The input thread keeps the input events selected on its own connection until it's stopped.
+		if ( thread_display != NULL )
+			XSelectInput( window->display, window->window, app_event_mask & ~INPUT_EXCLUSIVE_MASK );
+		else
+			input_restore_app_mask();
+	}
+}
+
+static void input_save_app_mask( void )
+{
+	XWindowAttributes attr;
+
+	// Both the hook and the input thread change the mask. Whichever comes first gets to save the original,
+	// the other one would only see what's left of it.
+	if ( app_mask_saved ) return;
+
+	XGetWindowAttributes( window->display, window->window, &attr );
+	app_event_mask = attr.your_event_mask;
+	app_mask_saved = true;
+}
+
+static void input_restore_app_mask( void )
+{
+	if ( !app_mask_saved ) return;
+
+	XSelectInput( window->display, window->window, app_event_mask );
+	app_mask_saved = false;
+}
+
+static void input_select_events( void )
+{
+	extern bool pointer_locked;
+	long mask = app_event_mask;
+
+	// Whatever the application has selected stays selected, only the events the library needs are added.
+	// The input thread has selected the input events for itself.
+	if ( thread_display != NULL )
+	{
+		XSelectInput( window->display, window->window, mask & ~INPUT_EXCLUSIVE_MASK );
+		return;
+	}
+
+	// Key releases are needed to keep track of modifier keys whenever key presses are selected.
+	if ( listeners & ( INPUT_EVENT_BIT(INPUT_CHARACTER)|INPUT_EVENT_BIT(INPUT_KEY_DOWN)|INPUT_EVENT_BIT(INPUT_KEY_UP) ) )
+		mask |= KeyPressMask|KeyReleaseMask;
+
+	if ( listeners & ( INPUT_EVENT_BIT(INPUT_MOUSE_WHEEL)|INPUT_EVENT_BIT(INPUT_LBUTTON_DOWN)|
+					   INPUT_EVENT_BIT(INPUT_MBUTTON_DOWN)|INPUT_EVENT_BIT(INPUT_RBUTTON_DOWN) ) )
+		mask |= ButtonPressMask;
+
+	// The press is needed as well to know which buttons are down when they're released.
+	if ( listeners & ( INPUT_EVENT_BIT(INPUT_LBUTTON_UP)|INPUT_EVENT_BIT(INPUT_MBUTTON_UP)|INPUT_EVENT_BIT(INPUT_RBUTTON_UP) ) )
+		mask |= ButtonPressMask|ButtonReleaseMask;
+
+	// Motion is by far the most frequent event, leave it out entirely when it's not needed.
+	if ( ( listeners & INPUT_EVENT_BIT(INPUT_MOUSE_MOVE) ) || pointer_locked )
+		mask |= PointerMotionMask;
+
+	XSelectInput( window->display, window->window, mask );
 }
 
-bool input_process( void* data )
+static uint32 input_merge_modifier( uint32 mods, bool down, uint32 left, uint32 both )
 {
+	if ( !down ) return mods & ~both;
+
+	// The modifier is down but we've missed its key event (it was pressed while the window wasn't focused).
+	// There's no telling which side it was, so just assume the left one.
+	if ( !( mods & both ) ) return mods | left;
+
+	return mods;
+}
+
+static void input_update_state( unsigned int state )
+{
+	// The state of an X event tells whether any shift/control/alt key is down, the side of the key is
+	// known from the key events we've seen.
+	modifiers = input_merge_modifier( modifiers, ( state & ShiftMask ) != 0, MODIFIER_LSHIFT, MODIFIER_SHIFT );
+	modifiers = input_merge_modifier( modifiers, ( state & ControlMask ) != 0, MODIFIER_LCONTROL, MODIFIER_CONTROL );
+	modifiers = input_merge_modifier( modifiers, ( state & (Mod1Mask|Mod5Mask) ) != 0,
+									  ( state & Mod1Mask ) ? MODIFIER_LALT : MODIFIER_RALT, MODIFIER_ALT );
+
+	buttons = 0;
+
+	if ( state & Button1Mask ) buttons |= MOUSEMASK_LBUTTON;
+	if ( state & Button2Mask ) buttons |= MOUSEMASK_MBUTTON;
+	if ( state & Button3Mask ) buttons |= MOUSEMASK_RBUTTON;
+}
+
+static uint32 input_get_state_key( XKeyEvent* key )
+{
+	uint32 code;
+
+	// The unshifted keysym is the same for the press and the release whatever modifiers are held at either,
+	// so the key state can't be left with a key that was pressed as one symbol and released as another.
+	code = (uint32)XkbKeycodeToKeysym( key->display, key->keycode, 0, 0 );
+	if ( code >= 'a' && code <= 'z' ) code -= ( 'a' - 'A' );
+
+	return code;
+}
+
+static void input_update_modifier_key( KeySym sym, bool down )
+{
+	uint32 flag;
+
+	switch ( sym )
+	{
+	case XK_Shift_L: flag = MODIFIER_LSHIFT; break;
+	case XK_Shift_R: flag = MODIFIER_RSHIFT; break;
+	case XK_Control_L: flag = MODIFIER_LCONTROL; break;
+	case XK_Control_R: flag = MODIFIER_RCONTROL; break;
+	case XK_Alt_L: flag = MODIFIER_LALT; break;
+	case XK_Alt_R: flag = MODIFIER_RALT; break;
+	case XK_ISO_Level3_Shift: flag = MODIFIER_RALT; break;
+	default: return;
+	}
+
+	if ( down ) modifiers |= flag;
+	else modifiers &= ~flag;
+}
+
+static uint32 input_get_button_mask( unsigned int button )
+{
+	switch ( button )
+	{
+	case Button1: return MOUSEMASK_LBUTTON;
+	case Button2: return MOUSEMASK_MBUTTON;
+	case Button3: return MOUSEMASK_RBUTTON;
+	}
+
+	return 0;
+}
+
+bool input_platform_process( void* data )
+{
+	extern bool pointer_locked;
+	extern int16 mouse_x, mouse_y;
 	XEvent* event = (XEvent*)data;
 	XKeyEvent* key;
 	XButtonEvent* button;
 	XMotionEvent* motion;
-	int16 x, y;
+	int16 x, y, dx, dy;
 	char buf[20];
 	KeySym sym;
-	uint32 code;
+	unsigned int consumed;
+	uint32 code, character;
 	bool ret = true;
 
+	// Called with no event to process the events read by the input thread.
+	if ( event == NULL )
+	{
+		input_process_thread_events();
+		return true;
+	}
+
+	// The input thread reads input events for itself, the application's own copies would be seen twice.
+	if ( thread_display != NULL && !processing_thread && event->type >= KeyPress && event->type <= MotionNotify )
+		return true;
+
 	switch ( event->type )
 	{
 	case KeyPress:
@@ -61,29 +600,31 @@ bool input_process( void* data )
 			key = (XKeyEvent*)event;
 			modifier_flags = key->state;
 
-			XLookupString( key, buf, sizeof(buf), &sym, NULL );
+			// Translating the key into text is only worth it when something listens to characters. Otherwise
+			// the keysym is looked up directly, XLookupString would come up with the same one.
+			if ( listeners & INPUT_EVENT_BIT(INPUT_CHARACTER) )
+			{
+				character = XLookupString( key, buf, sizeof(buf), &sym, NULL ) > 0 ? (uint8)buf[0] : 0;
+			}
+			else
+			{
+				if ( !XkbLookupKeySym( key->display, key->keycode, key->state, &consumed, &sym ) ) sym = NoSymbol;
+				character = 0;
+			}
+
 			code = (uint32)sym;
 
+			// The state of the event is the state before the key was pressed.
+			input_update_state( key->state );
+			input_update_modifier_key( sym, true );
+			input_set_event_state( modifiers, buttons );
+
 			// A dodgy fix to make windows and linux hooks/binds compatible:
 			// Convert lowercase characters to upper case before processing hooks.
 			if ( code >= 'a' && code <= 'z' ) code -= ( 'a' - 'A' );
 
-			ret = input_handle_keyboard_event( INPUT_KEY_DOWN, code );
-			if ( ret )
-			{
-				ret = input_handle_key_down_bind( code );
-			}
-
-			if ( !ret ) return false;
-			if ( !*buf ) return ret;
-
-			ret = input_handle_keyboard_event( INPUT_CHARACTER, buf[0] );
-			if ( ret )
-			{
-				ret = input_handle_char_bind( buf[0] );
-			}
-
-			return ret;
+			// The character (if any) is dispatched right after the key unless the key press is consumed.
+			return input_post_key_event( INPUT_KEY_DOWN, code, input_get_state_key( key ), character );
 		}
 
 	case KeyRelease:
@@ -92,13 +633,14 @@ bool input_process( void* data )
 			key = (XKeyEvent*)event;
 			sym = (uint32)XkbKeycodeToKeysym( window->display, key->keycode, 0, 0 );
 
-			ret = input_handle_keyboard_event( INPUT_KEY_UP, (uint32)sym );
-			if ( ret )
-			{
-				ret = input_handle_key_up_bind( (uint32)sym );
-			}
-
-			return ret;
+			input_update_state( key->state );
+			input_update_modifier_key( sym, false );
+			input_set_event_state( modifiers, buttons );
+
+			// Letters are released in upper case just like they're pressed.
+			code = input_get_state_key( key );
+
+			return input_post_key_event( INPUT_KEY_UP, code, code, 0 );
 		}
 
 	case ButtonPress:
@@ -108,41 +650,52 @@ bool input_process( void* data )
 			x = (int16)button->x;
 			y = (int16)button->y;
 
+			if ( pointer_locked )
+			{
+				// The cursor is frozen while the pointer is locked.
+				x = mouse_x;
+				y = mouse_y;
+			}
+
+			input_update_state( button->state );
+			buttons |= input_get_button_mask( button->button );
+			input_set_event_state( modifiers, buttons );
+
 			switch ( button->button )
 			{
 			case Button1:
-				// Left mouse button
-				XGrabPointer( button->display, button->window, False, ButtonPressMask|ButtonReleaseMask|
-								PointerMotionMask|FocusChangeMask|EnterWindowMask|LeaveWindowMask,
-								GrabModeAsync, GrabModeAsync, button->window, None, CurrentTime );
+				// Left mouse button, the pointer lock already holds a grab of its own. The input thread makes its own grab.
+				if ( !pointer_locked && !processing_thread )
+				{
+					XGrabPointer( button->display, button->window, False, ButtonPressMask|ButtonReleaseMask|
+									PointerMotionMask|FocusChangeMask|EnterWindowMask|LeaveWindowMask,
+									GrabModeAsync, GrabModeAsync, button->window, None, CurrentTime );
+				}
 
-				ret = input_handle_mouse_event( INPUT_LBUTTON_DOWN, x, y, MOUSE_LBUTTON, MWHEEL_STATIONARY );
-				if ( ret ) input_handle_mouse_down_bind( MOUSE_LBUTTON, x, y );
+				ret = input_post_mouse_event( INPUT_LBUTTON_DOWN, x, y, MOUSE_LBUTTON, MWHEEL_STATIONARY );
 
 				break;
 
 			case Button3:
 				// Right mouse button
-				ret = input_handle_mouse_event( INPUT_RBUTTON_DOWN, x, y, MOUSE_RBUTTON, MWHEEL_STATIONARY );
-				if ( ret ) input_handle_mouse_down_bind( MOUSE_RBUTTON, x, y );
+				ret = input_post_mouse_event( INPUT_RBUTTON_DOWN, x, y, MOUSE_RBUTTON, MWHEEL_STATIONARY );
 
 				break;
 
 			case Button2:
 				// Middle mouse button (wheel)
-				ret = input_handle_mouse_event( INPUT_MBUTTON_DOWN, x, y, MOUSE_MBUTTON, MWHEEL_STATIONARY );
-				if ( ret ) input_handle_mouse_down_bind( MOUSE_MBUTTON, x, y );
+				ret = input_post_mouse_event( INPUT_MBUTTON_DOWN, x, y, MOUSE_MBUTTON, MWHEEL_STATIONARY );
 
 				break;
 
 			case Button4:
 				// Mouse wheel scroll up
-				ret = input_handle_mouse_event( INPUT_MOUSE_WHEEL, x, y, MOUSE_NONE, MWHEEL_UP );
+				ret = input_post_mouse_event( INPUT_MOUSE_WHEEL, x, y, MOUSE_NONE, MWHEEL_UP );
 				break;
 
 			case Button5:
 				// Mouse wheel scroll down
-				ret = input_handle_mouse_event( INPUT_MOUSE_WHEEL,x, y, MOUSE_NONE, MWHEEL_DOWN );
+				ret = input_post_mouse_event( INPUT_MOUSE_WHEEL, x, y, MOUSE_NONE, MWHEEL_DOWN );
 				break;
 			}
 
@@ -156,28 +709,36 @@ bool input_process( void* data )
 			x = (int16)button->x;
 			y = (int16)button->y;
 
+			if ( pointer_locked )
+			{
+				x = mouse_x;
+				y = mouse_y;
+			}
+
+			input_update_state( button->state );
+			buttons &= ~input_get_button_mask( button->button );
+			input_set_event_state( modifiers, buttons );
+
 			switch ( button->button )
 			{
 			case Button1:
 				// Left mouse button
-				XUngrabPointer( button->display, CurrentTime );
+				if ( !pointer_locked && !processing_thread )
+					XUngrabPointer( button->display, CurrentTime );
 
-				ret = input_handle_mouse_event( INPUT_LBUTTON_UP, x, y, MOUSE_LBUTTON, MWHEEL_STATIONARY );
-				if ( ret ) input_handle_mouse_up_bind( MOUSE_LBUTTON, x, y );
+				ret = input_post_mouse_event( INPUT_LBUTTON_UP, x, y, MOUSE_LBUTTON, MWHEEL_STATIONARY );
 
 				break;
 
-			case Button2:
+			case Button3:
 				// Right mouse button
-				ret = input_handle_mouse_event( INPUT_RBUTTON_UP, x, y, MOUSE_RBUTTON, MWHEEL_STATIONARY );
-				if ( ret ) input_handle_mouse_up_bind( MOUSE_RBUTTON, x, y );
+				ret = input_post_mouse_event( INPUT_RBUTTON_UP, x, y, MOUSE_RBUTTON, MWHEEL_STATIONARY );
 
 				break;
 
-			case Button3:
+			case Button2:
 				// Middle mouse button (wheel)
-				ret = input_handle_mouse_event( INPUT_MBUTTON_UP, x, y, MOUSE_MBUTTON, MWHEEL_STATIONARY );
-				if ( ret ) input_handle_mouse_up_bind( MOUSE_MBUTTON, x, y );
+				ret = input_post_mouse_event( INPUT_MBUTTON_UP, x, y, MOUSE_MBUTTON, MWHEEL_STATIONARY );
 
 				break;
 			}
@@ -191,13 +752,43 @@ bool input_process( void* data )
 			x = (int16)motion->x;
 			y = (int16)motion->y;
 
-			ret = input_handle_mouse_event( INPUT_MOUSE_MOVE, x, y, MOUSE_NONE, MWHEEL_STATIONARY );
-			if ( ret )
+			input_update_state( motion->state );
+			input_set_event_state( modifiers, buttons );
+
+			// The first event generated after the server processed our XWarpPointer request carries its serial
+			// or a later one. Motion from then on is relative to where the pointer was sent, and the event caused
+			// by the warp itself is dropped. A warp to where the pointer already was causes no event at all.
+			// Events read by the input thread carry serials of the thread's connection, which have nothing to do
+			// with warp_serial. Those are matched by position instead, X doesn't merge motion so the event caused
+			// by the warp lands exactly on the target.
+			if ( warp_pending && ( processing_thread ? ( x == warp_x && y == warp_y ) :
+								   (long)( motion->serial - warp_serial ) >= 0 ) )
 			{
-				ret = input_handle_mouse_move_bind( x, y );
+				warp_pending = false;
+				lock_x = warp_x;
+				lock_y = warp_y;
+
+				if ( x == warp_x && y == warp_y ) return false;
 			}
 
-			return ret;
+			if ( pointer_locked )
+			{
+				dx = x - lock_x;
+				dy = y - lock_y;
+
+				lock_x = x;
+				lock_y = y;
+
+				// Move the pointer back to the centre only when it gets close to the edges of the window.
+				if ( !warp_pending && ( x < lock_w / 4 || x > 3 * lock_w / 4 || y < lock_h / 4 || y > 3 * lock_h / 4 ) )
+					input_warp_pointer( lock_w / 2, lock_h / 2 );
+
+				if ( dx == 0 && dy == 0 ) return false;
+
+				return input_post_relative_mouse_event( dx, dy );
+			}
+
+			return input_post_mouse_event( INPUT_MOUSE_MOVE, x, y, MOUSE_NONE, MWHEEL_STATIONARY );
 		}
 	}
 
@@ -299,6 +890,17 @@ void input_show_mouse_cursor_ref( bool show )
 	}
 }
 
+static void input_warp_pointer( int16 x, int16 y )
+{
+	// Remember the request so the MotionNotify caused by the warp can be told apart from real motion.
+	warp_pending = true;
+	warp_serial = NextRequest( window->display );
+	warp_x = x;
+	warp_y = y;
+
+	XWarpPointer( window->display, None, window->window, 0, 0, 0, 0, x, y );
+}
+
 void input_set_cursor_pos( int16 x, int16 y )
 {
 	extern int16 mouse_x, mouse_y;
@@ -306,7 +908,50 @@ void input_set_cursor_pos( int16 x, int16 y )
 	mouse_x = x;
 	mouse_y = y;
 
-	XWarpPointer( window->display, None, RootWindow(window->display, window->window), 0, 0, 0, 0, x, y );
+	input_warp_pointer( x, y );
+}
+
+void input_set_pointer_lock( bool lock )
+{
+	extern bool pointer_locked, show_cursor;
+	extern int16 mouse_x, mouse_y;
+	XWindowAttributes attr;
+
+	if ( window == NULL || lock == pointer_locked ) return;
+
+	if ( lock )
+	{
+		XGetWindowAttributes( window->display, window->window, &attr );
+
+		lock_w = (int16)attr.width;
+		lock_h = (int16)attr.height;
+		lock_x = mouse_x;
+		lock_y = mouse_y;
+
+		// Hide the cursor and confine it to the window for as long as the lock is active.
+		input_hide_mouse_cursor();
+
+		XGrabPointer( window->display, window->window, False, ButtonPressMask|ButtonReleaseMask|PointerMotionMask,
+					  GrabModeAsync, GrabModeAsync, window->window, None, CurrentTime );
+
+		input_warp_pointer( lock_w / 2, lock_h / 2 );
+	}
+	else
+	{
+		XUngrabPointer( window->display, CurrentTime );
+
+		if ( show_cursor )
+			XUndefineCursor( window->display, window->window );
+
+		// Return the pointer to where it was when the lock was enabled.
+		input_warp_pointer( mouse_x, mouse_y );
+	}
+
+	pointer_locked = lock;
+
+	// Relative motion has to be received even if nothing listens to absolute motion.
+	if ( input_hooked )
+		input_select_events();
 }
 
 #endif /* _WIN32 */
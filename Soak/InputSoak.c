@@ -0,0 +1,443 @@
+/**********************************************************************
+ *
+ * PROJECT:		Mylly Input library
+ * FILE:		InputSoak.c
+ * LICENCE:		See Licence.txt
+ * PURPOSE:		A portable input hooker library.
+ *				Soak test hammering bind churn and event dispatch.
+ *
+ *				(c) Tuomo Jauhiainen 2012-13
+ *
+ **********************************************************************/
+
+#include "Input.h"
+#include "InputSys.h"
+#include "Platform/Window.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <X11/Xlib.h>
+#endif
+
+/*
+ * Usage: InputSoak [operations per round] [rounds] [seed]
+ *
+ * Every round runs the same pseudo random sequence of bind adds and removals (some of them from inside
+ * the handlers while a dispatch is in progress), posted events and switches between direct and queued
+ * dispatch. Queued events are dispatched without a time budget so that the rounds stay identical.
+ * The stats counters are checked against what the soak has done at regular checkpoints, and every
+ * round has to end with exactly the same memory use as the first one did. Before the rounds, a press and
+ * release of a letter and of a shifted key have to leave the published key state clear.
+ */
+
+#define SOAK_KEY_BINDS			512			// Most key binds alive at once
+#define SOAK_MOUSE_BINDS		256			// Most mouse binds alive at once
+#define SOAK_CHECKPOINT			4096		// Operations between checks of the stats
+#define SOAK_CONSUME_KEY		'Q'			// Key with a down bind that consumes every press
+
+#ifdef _WIN32
+#define SOAK_SHARED_NAME		"InputSoak"
+#else
+#define SOAK_SHARED_NAME		"/InputSoak"
+#endif
+
+#define soak_check(x) \
+	if ( !( x ) ) { fprintf( stderr, "InputSoak: check failed at operation %u: %s\n", operation, #x ); exit( 1 ); }
+
+// --------------------------------------------------
+
+typedef struct {
+	KeyBind*		handle;
+	BINDTYPE_KB		type;
+} SoakKeyBind;
+
+typedef struct {
+	MouseBind*		handle;
+	BINDTYPE_MOUSE	type;
+} SoakMouseBind;
+
+static SoakKeyBind		key_binds[SOAK_KEY_BINDS];		// Key binds added by the soak, handle is NULL for free entries
+static SoakMouseBind	mouse_binds[SOAK_MOUSE_BINDS];	// Mouse binds added by the soak
+static uint64			posted[NUM_INPUT_EVENTS];		// Events posted since the library was initialized
+static uint64			consumer_calls		= 0;		// Presses consumed by the SOAK_CONSUME_KEY bind
+static uint32			random_state		= 1;
+static uint32			operation			= 0;		// Operation of the round being run
+
+// --------------------------------------------------
+
+static uint32 soak_random( uint32 range )
+{
+	// xorshift32, the rounds have to be repeatable whatever the C library's rand does.
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+
+	return random_state % range;
+}
+
+static void soak_random_rect( rectangle_t* r )
+{
+	r->x = (int16)soak_random( 800 );
+	r->y = (int16)soak_random( 600 );
+	r->w = (int16)( 1 + soak_random( 200 ) );
+	r->h = (int16)( 1 + soak_random( 200 ) );
+}
+
+static bool soak_key_handler( uint32 key, void* data );
+static bool soak_mouse_handler( MOUSEBTN button, uint16 x, uint16 y, void* data );
+
+static void soak_add_key_bind( void )
+{
+	SoakKeyBind* bind = &key_binds[soak_random( SOAK_KEY_BINDS )];
+	uint32 key = 'A' + soak_random( 26 );
+
+	if ( bind->handle != NULL ) return;
+
+	bind->type = (BINDTYPE_KB)soak_random( NUM_KEYBIND_TYPES );
+
+	switch ( bind->type )
+	{
+	case BIND_KEYUP:	bind->handle = input_add_key_up_bind( key, soak_key_handler, NULL ); break;
+	case BIND_KEYDOWN:	bind->handle = input_add_key_down_bind( key, soak_key_handler, NULL ); break;
+	default:			bind->handle = input_add_char_bind( key, soak_key_handler, NULL ); break;
+	}
+
+	soak_check( bind->handle != NULL );
+}
+
+static void soak_remove_key_bind( void )
+{
+	SoakKeyBind* bind = &key_binds[soak_random( SOAK_KEY_BINDS )];
+
+	if ( bind->handle == NULL ) return;
+
+	input_remove_key_bind( bind->handle );
+	bind->handle = NULL;
+}
+
+static void soak_add_mouse_bind( void )
+{
+	SoakMouseBind* bind = &mouse_binds[soak_random( SOAK_MOUSE_BINDS )];
+	MOUSEBTN button = (MOUSEBTN)( MOUSE_LBUTTON + soak_random( 3 ) );
+	rectangle_t r;
+
+	if ( bind->handle != NULL ) return;
+
+	soak_random_rect( &r );
+	bind->type = (BINDTYPE_MOUSE)soak_random( NUM_MOUSEBIND_TYPES );
+
+	switch ( bind->type )
+	{
+	case BIND_BTNUP:	bind->handle = input_add_mousebtn_up_bind( button, &r, soak_mouse_handler, NULL ); break;
+	case BIND_BTNDOWN:	bind->handle = input_add_mousebtn_down_bind( button, &r, soak_mouse_handler, NULL ); break;
+	case BIND_MOVE:		bind->handle = input_add_mouse_move_bind( &r, soak_mouse_handler, NULL ); break;
+	case BIND_ENTER:	bind->handle = input_add_mouse_enter_bind( &r, soak_mouse_handler, NULL ); break;
+	default:			bind->handle = input_add_mouse_leave_bind( &r, soak_mouse_handler, NULL ); break;
+	}
+
+	soak_check( bind->handle != NULL );
+}
+
+static void soak_remove_mouse_bind( void )
+{
+	SoakMouseBind* bind = &mouse_binds[soak_random( SOAK_MOUSE_BINDS )];
+
+	if ( bind->handle == NULL ) return;
+
+	input_remove_mouse_bind( bind->handle );
+	bind->handle = NULL;
+}
+
+static void soak_change_mouse_bind( void )
+{
+	SoakMouseBind* bind = &mouse_binds[soak_random( SOAK_MOUSE_BINDS )];
+	rectangle_t r;
+
+	if ( bind->handle == NULL ) return;
+
+	soak_random_rect( &r );
+	input_set_mousebind_rect( bind->handle, &r );
+}
+
+static bool soak_key_handler( uint32 key, void* data )
+{
+	// Churn the binds while the dispatch is iterating over them.
+	switch ( soak_random( 32 ) )
+	{
+	case 0: soak_remove_key_bind(); break;
+	case 1: soak_add_key_bind(); break;
+	}
+
+	return true;
+}
+
+static bool soak_mouse_handler( MOUSEBTN button, uint16 x, uint16 y, void* data )
+{
+	switch ( soak_random( 64 ) )
+	{
+	case 0: soak_remove_mouse_bind(); break;
+	case 1: soak_add_mouse_bind(); break;
+	case 2: soak_change_mouse_bind(); break;
+	}
+
+	return true;
+}
+
+static bool soak_consume_handler( uint32 key, void* data )
+{
+	consumer_calls++;
+	return false;
+}
+
+// --------------------------------------------------
+
+static void soak_post_key( INPUT_EVENT type, uint32 key )
+{
+	posted[type]++;
+	input_post_keyboard_event( type, key, 0 );
+}
+
+static void soak_post_mouse( INPUT_EVENT type, MOUSEBTN button )
+{
+	posted[type]++;
+	input_post_mouse_event( type, (int16)soak_random( 1000 ), (int16)soak_random( 800 ), button, MWHEEL_STATIONARY );
+}
+
+static void soak_post_events( void )
+{
+	static const INPUT_EVENT button_events[] = {
+		INPUT_LBUTTON_DOWN, INPUT_LBUTTON_UP, INPUT_MBUTTON_DOWN, INPUT_MBUTTON_UP, INPUT_RBUTTON_DOWN, INPUT_RBUTTON_UP
+	};
+	uint32 i, key, button;
+
+	switch ( soak_random( 4 ) )
+	{
+	case 0:
+		key = soak_random( 8 ) == 0 ? SOAK_CONSUME_KEY : 'A' + soak_random( 26 );
+		soak_post_key( INPUT_KEY_DOWN, key );
+		soak_post_key( INPUT_KEY_UP, key );
+		break;
+
+	case 1:
+		// A burst of motion, which is what fills up the queue.
+		for ( i = soak_random( 64 ); i--; )
+			soak_post_mouse( INPUT_MOUSE_MOVE, MOUSE_NONE );
+		break;
+
+	case 2:
+		button = soak_random( 3 );
+		soak_post_mouse( button_events[button * 2], (MOUSEBTN)( MOUSE_LBUTTON + button ) );
+		soak_post_mouse( button_events[button * 2 + 1], (MOUSEBTN)( MOUSE_LBUTTON + button ) );
+		break;
+
+	default:
+		soak_post_mouse( INPUT_MOUSE_WHEEL, MOUSE_NONE );
+		break;
+	}
+}
+
+static void soak_check_stats( void )
+{
+	InputStats stats;
+	uint32 i, j, binds;
+
+	// Everything posted has to be accounted for once the queue is empty.
+	while ( input_dispatch( 0 ) != 0 ) {}
+
+	input_get_stats( &stats );
+
+	soak_check( stats.queue_depth == 0 );
+
+	for ( i = 0; i < NUM_INPUT_EVENTS; i++ )
+	{
+		soak_check( stats.events[i].received == posted[i] );
+		soak_check( stats.events[i].dispatched + stats.events[i].coalesced + stats.events[i].dropped == posted[i] );
+		soak_check( stats.events[i].blocked == 0 );
+		soak_check( stats.events[i].consumed == ( i == INPUT_KEY_DOWN ? consumer_calls : 0 ) );
+	}
+
+	// Releases are never dropped, not even when the queue is full.
+	soak_check( stats.events[INPUT_KEY_UP].dropped == 0 );
+	soak_check( stats.events[INPUT_LBUTTON_UP].dropped == 0 );
+	soak_check( stats.events[INPUT_MBUTTON_UP].dropped == 0 );
+	soak_check( stats.events[INPUT_RBUTTON_UP].dropped == 0 );
+
+	for ( i = 0; i < NUM_KEYBIND_TYPES; i++ )
+	{
+		binds = ( i == BIND_KEYDOWN ) ? 1 : 0;
+
+		for ( j = 0; j < SOAK_KEY_BINDS; j++ )
+			binds += ( key_binds[j].handle != NULL && key_binds[j].type == (BINDTYPE_KB)i );
+
+		soak_check( stats.key_binds[i] == binds );
+	}
+
+	for ( i = 0; i < NUM_MOUSEBIND_TYPES; i++ )
+	{
+		binds = 0;
+
+		for ( j = 0; j < SOAK_MOUSE_BINDS; j++ )
+			binds += ( mouse_binds[j].handle != NULL && mouse_binds[j].type == (BINDTYPE_MOUSE)i );
+
+		soak_check( stats.mouse_binds[i] == binds );
+	}
+
+	soak_check( stats.bind_slots <= SOAK_KEY_BINDS + SOAK_MOUSE_BINDS + 1 );
+	soak_check( stats.memory_used <= stats.memory_peak );
+}
+
+static void soak_check_shared_state( void )
+{
+	// Key events and the key each one is tracked by in the key state. X11 reports shift+1 pressed as '!' but
+	// released as '1', the state has to go by the unshifted key for the bit to get cleared.
+	static const uint32 keys[][2] = { { 'A', 'A' }, { '!', '1' } };
+	InputSharedRegion* region;
+	InputSharedState state;
+	uint32 i;
+
+	soak_check( input_publish_state( SOAK_SHARED_NAME ) );
+
+	region = input_open_shared_state( SOAK_SHARED_NAME );
+	soak_check( region != NULL );
+
+	for ( i = 0; i < sizeof(keys) / sizeof(keys[0]); i++ )
+	{
+		posted[INPUT_KEY_DOWN]++;
+		input_post_key_event( INPUT_KEY_DOWN, keys[i][0], keys[i][1], 0 );
+
+		soak_check( input_read_shared_state( region, &state ) );
+		soak_check( INPUT_SHARED_KEY_DOWN( &state, keys[i][1] ) );
+
+		posted[INPUT_KEY_UP]++;
+		input_post_key_event( INPUT_KEY_UP, keys[i][1], keys[i][1], 0 );
+	}
+
+	// Every press has been released, so the bitmap has to be clear.
+	soak_check( input_read_shared_state( region, &state ) );
+
+	for ( i = 0; i < INPUT_SHARED_KEYS / 32; i++ )
+		soak_check( state.keys[i] == 0 );
+
+	input_close_shared_state( region );
+	input_publish_state( NULL );
+}
+
+static void soak_run_round( uint32 operations, uint32 seed )
+{
+	uint32 i;
+
+	random_state = seed;
+
+	for ( i = 0; i < operations; i++ )
+	{
+		operation = i;
+
+		switch ( soak_random( 16 ) )
+		{
+		case 0: case 1: case 2:		soak_add_key_bind(); break;
+		case 3: case 4:				soak_remove_key_bind(); break;
+		case 5:						soak_add_mouse_bind(); break;
+		case 6:						soak_remove_mouse_bind(); break;
+		case 7:						soak_change_mouse_bind(); break;
+		case 13:					input_set_queued_dispatch( soak_random( 2 ) != 0 ); break;
+		case 14:					input_dispatch( 0 ); break;
+		default:					soak_post_events(); break;
+		}
+
+		if ( ( i + 1 ) % SOAK_CHECKPOINT == 0 )
+			soak_check_stats();
+	}
+
+	input_set_queued_dispatch( false );
+
+	for ( i = 0; i < SOAK_KEY_BINDS; i++ )
+	{
+		if ( key_binds[i].handle != NULL ) input_remove_key_bind( key_binds[i].handle );
+		key_binds[i].handle = NULL;
+	}
+
+	for ( i = 0; i < SOAK_MOUSE_BINDS; i++ )
+	{
+		if ( mouse_binds[i].handle != NULL ) input_remove_mouse_bind( mouse_binds[i].handle );
+		mouse_binds[i].handle = NULL;
+	}
+
+	operation = operations;
+	soak_check_stats();
+}
+
+// --------------------------------------------------
+
+int main( int argc, char** argv )
+{
+	uint32 operations, rounds, seed, round;
+	InputStats stats;
+	uint64 memory_used = 0;
+	uint32 bind_slots = 0;
+#ifdef _WIN32
+	HWND window;
+
+	window = CreateWindowA( "STATIC", "InputSoak", WS_OVERLAPPEDWINDOW, 0, 0, 800, 600, NULL, NULL, NULL, NULL );
+	if ( window == NULL ) { fprintf( stderr, "InputSoak: could not create a window\n" ); return 1; }
+
+	input_initialize( window );
+#else
+	syswindow_t window;
+
+	memset( &window, 0, sizeof(window) );
+
+	window.display = XOpenDisplay( NULL );
+	if ( window.display == NULL ) { fprintf( stderr, "InputSoak: could not open the display\n" ); return 1; }
+
+	window.window = XCreateSimpleWindow( window.display, DefaultRootWindow( window.display ), 0, 0, 800, 600, 0, 0, 0 );
+
+	input_initialize( &window );
+#endif
+
+	operations = argc > 1 ? (uint32)strtoul( argv[1], NULL, 10 ) : 1000000;
+	rounds = argc > 2 ? (uint32)strtoul( argv[2], NULL, 10 ) : 4;
+	seed = argc > 3 ? (uint32)strtoul( argv[3], NULL, 10 ) : 1;
+
+	if ( seed == 0 ) seed = 1;
+
+	soak_check_shared_state();
+
+	// The consumer is never removed, every press of its key it gets to is counted as consumed.
+	input_add_key_down_bind( SOAK_CONSUME_KEY, soak_consume_handler, NULL );
+
+	for ( round = 0; round < rounds; round++ )
+	{
+		soak_run_round( operations, seed );
+		input_get_stats( &stats );
+
+		printf( "InputSoak: round %u: %llu bytes used, %llu peak, %u bind slots\n", round + 1,
+				(unsigned long long)stats.memory_used, (unsigned long long)stats.memory_peak, stats.bind_slots );
+
+		// Identical rounds have to leave the library exactly as big as the first one did.
+		if ( round == 0 )
+		{
+			memory_used = stats.memory_used;
+			bind_slots = stats.bind_slots;
+		}
+
+		soak_check( stats.memory_used == memory_used );
+		soak_check( stats.bind_slots == bind_slots );
+	}
+
+	input_shutdown();
+
+#ifdef _WIN32
+	DestroyWindow( window );
+#else
+	XDestroyWindow( window.display, window.window );
+	XCloseDisplay( window.display );
+#endif
+
+	printf( "InputSoak: passed\n" );
+
+	return 0;
+}
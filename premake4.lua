@@ -4,10 +4,14 @@ project "Lib-Input"
 	kind "StaticLib"
 	language "C"
 	files { "**.h", "**.c", "premake4.lua" }
+	excludes { "Soak/**" }
 	vpaths { [""] = { "../Libraries/Input" } }
 	includedirs { ".", ".." }
 	location ( "../../Projects/" .. os.get() .. "/" .. _ACTION )
 	
+	-- Uncomment to enable event tracing (input_trace_start/input_trace_write)
+	-- defines { "INPUT_TRACE" }
+	
 	-- Linux specific stuff
 	configuration "linux"
 		targetextension ".a"
@@ -21,3 +25,27 @@ project "Lib-Input"
 		buildoptions { "/wd4201 /wd4206" } -- C4201: nameless struct/union, C4206: translation unit is empty
 		configuration "Debug" targetname "inputd"
 		configuration "Release" targetname "input"
+
+-- Soak test, a standalone program hammering bind churn and event dispatch (see Soak/InputSoak.c)
+
+project "Input-Soak"
+	kind "ConsoleApp"
+	language "C"
+	files { "Soak/**.c" }
+	includedirs { ".", ".." }
+	links { "Lib-Input", "Lib-Platform" }
+	location ( "../../Projects/" .. os.get() .. "/" .. _ACTION )
+	
+	-- Linux specific stuff
+	configuration "linux"
+		buildoptions { "-fms-extensions" } -- Unnamed struct/union fields within structs/unions
+		links { "X11", "pthread", "rt" }
+		configuration "Debug" targetname "input-soakd"
+		configuration "Release" targetname "input-soak"
+	
+	-- Windows specific stuff
+	configuration "windows"
+		buildoptions { "/wd4201 /wd4206" } -- C4201: nameless struct/union, C4206: translation unit is empty
+		links { "user32" }
+		configuration "Debug" targetname "input-soakd"
+		configuration "Release" targetname "input-soak"